@@ -0,0 +1,369 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/archive.h"
+#include "startrek/lzss.h"
+#include "startrek/membercache.h"
+#include "startrek/memtrack.h"
+
+#include "common/file.h"
+#include "common/memstream.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+// A range of the data file, which other members are read from as well.
+// The position is kept here and set again before every read.
+class SharedSubReadStream : public Common::SeekableReadStream {
+public:
+	SharedSubReadStream(Common::SeekableReadStream *parent, uint32 begin, uint32 size) : _parent(parent), _begin(begin), _size(size), _pos(0), _eos(false) {}
+
+	bool eos() const { return _eos; }
+	bool err() const { return _parent->err(); }
+	void clearErr() { _eos = false; _parent->clearErr(); }
+
+	uint32 read(void *dataPtr, uint32 dataSize) {
+		if (dataSize > _size - _pos) {
+			dataSize = _size - _pos;
+			_eos = true;
+		}
+
+		_parent->seek(_begin + _pos);
+		dataSize = _parent->read(dataPtr, dataSize);
+		_pos += dataSize;
+		return dataSize;
+	}
+
+	int32 pos() const { return _pos; }
+	int32 size() const { return _size; }
+
+	bool seek(int32 offset, int whence = SEEK_SET) {
+		if (whence == SEEK_CUR)
+			offset += _pos;
+		else if (whence == SEEK_END)
+			offset += _size;
+
+		if (offset < 0 || offset > (int32)_size)
+			return false;
+
+		_pos = offset;
+		_eos = false;
+		return true;
+	}
+
+private:
+	Common::SeekableReadStream *_parent;
+	uint32 _begin;
+	uint32 _size;
+	uint32 _pos;
+	bool _eos;
+};
+
+template<class Format>
+bool IndexedArchive<Format>::loadIndex(Common::SeekableReadStream *indexStream) {
+	uint32 size = indexStream->size();
+	byte *data = (byte *)malloc(MAX<uint32>(size, 1));
+	indexStream->read(data, size);
+
+	bool loaded = !indexStream->err() && parseArchiveIndex<Format>(data, size, _index);
+	free(data);
+	return loaded;
+}
+
+template<class Format>
+Common::SeekableReadStream *IndexedArchive<Format>::openFile(const Common::String &filename) {
+	MemberInfo info;
+	return openMember(filename, info);
+}
+
+template<class Format>
+Common::SeekableReadStream *IndexedArchive<Format>::openMember(const Common::String &filename, MemberInfo &info) {
+	ArchiveIndex::const_iterator it = _index.find(filename);
+	if (it == _index.end())
+		return 0;
+
+	const ArchiveEntry &entry = it->_value;
+	info.storedSize = info.expectedSize = info.decodedSize = 0;
+	info.partCount = entry.fileCount;
+
+	_dataStream->seek(entry.offset);
+
+	if (!Format::kCompressed) {
+		if (_stats)
+			_stats->bytesRead += entry.size;
+		info.storedSize = info.expectedSize = info.decodedSize = entry.size;
+		return trackStream(_dataStream->readStream(entry.size), filename);
+	}
+
+	debug(5, "Opening file \'%s\'", filename.c_str());
+
+	// The parts of a multi-part member follow each other, each with its own
+	// header. The member is their decoded data joined.
+	byte memberHeader[MEMBER_HEADER_SIZE];
+	uint16 uncompressedSize, compressedSize;
+
+	for (uint16 i = 0; i < entry.fileCount; i++) {
+		_dataStream->read(memberHeader, MEMBER_HEADER_SIZE);
+		parseMemberHeader<Format>(memberHeader, uncompressedSize, compressedSize);
+		info.storedSize += compressedSize;
+		info.expectedSize += uncompressedSize;
+		_dataStream->skip(compressedSize);
+	}
+
+	if (_memberCache) {
+		Common::SeekableReadStream *cached = _memberCache->openMember(filename);
+		if (cached && (uint32)cached->size() == info.expectedSize) {
+			// Read from the cache file, so not held in memory here
+			info.decodedSize = info.expectedSize;
+			return cached;
+		}
+		delete cached;
+	}
+
+	if (_stats) {
+		_stats->bytesRead += entry.fileCount * MEMBER_HEADER_SIZE + info.storedSize;
+		_stats->bytesDecompressed += info.expectedSize;
+	}
+
+	_dataStream->seek(entry.offset);
+	Common::SeekableReadStream *stream;
+
+	if (entry.fileCount == 1) {
+		_dataStream->read(memberHeader, MEMBER_HEADER_SIZE);
+		parseMemberHeader<Format>(memberHeader, uncompressedSize, compressedSize);
+
+		Common::SeekableReadStream *compressed = _dataStream->readStream(compressedSize);
+		stream = decodeLZSS(compressed, uncompressedSize, _arena, &info.decodedSize);
+		delete compressed;
+	} else {
+		byte *data = (byte *)malloc(MAX<uint32>(info.expectedSize, 1));
+		uint32 pos = 0;
+
+		for (uint16 i = 0; i < entry.fileCount; i++) {
+			_dataStream->read(memberHeader, MEMBER_HEADER_SIZE);
+			parseMemberHeader<Format>(memberHeader, uncompressedSize, compressedSize);
+
+			Common::SeekableReadStream *compressed = _dataStream->readStream(compressedSize);
+			uint32 partDecodedSize = 0;
+			Common::SeekableReadStream *part = decodeLZSS(compressed, uncompressedSize, _arena, &partDecodedSize);
+			delete compressed;
+
+			pos += part->read(data + pos, uncompressedSize);
+			info.decodedSize += partDecodedSize;
+			delete part;
+		}
+
+		stream = new Common::MemoryReadStream(data, info.expectedSize, DisposeAfterUse::YES);
+	}
+
+	// Only members that decoded whole are shared
+	if (_memberCache && stream && info.decodedSize == info.expectedSize)
+		_memberCache->storeMember(filename, stream);
+	return trackStream(stream, filename);
+}
+
+template<class Format>
+Common::SeekableReadStream *IndexedArchive<Format>::openStreamingFile(const Common::String &filename) {
+	ArchiveIndex::const_iterator it = _index.find(filename);
+	if (it == _index.end())
+		return 0;
+
+	const ArchiveEntry &entry = it->_value;
+	if (entry.fileCount != 1)
+		return openFile(filename);
+
+	if (!Format::kCompressed) {
+		if (_stats)
+			_stats->bytesRead += entry.size;
+		return new SharedSubReadStream(_dataStream, entry.offset, entry.size);
+	}
+
+	byte memberHeader[MEMBER_HEADER_SIZE];
+	uint16 uncompressedSize, compressedSize;
+
+	_dataStream->seek(entry.offset);
+	_dataStream->read(memberHeader, MEMBER_HEADER_SIZE);
+	parseMemberHeader<Format>(memberHeader, uncompressedSize, compressedSize);
+
+	if (_memberCache) {
+		Common::SeekableReadStream *cached = _memberCache->openMember(filename);
+		if (cached && (uint32)cached->size() == uncompressedSize)
+			return cached;
+		delete cached;
+	}
+
+	if (_stats) {
+		_stats->bytesRead += MEMBER_HEADER_SIZE + compressedSize;
+		_stats->bytesDecompressed += uncompressedSize;
+	}
+
+	Common::SeekableReadStream *compressed = new SharedSubReadStream(_dataStream, entry.offset + MEMBER_HEADER_SIZE, compressedSize);
+	return new LZSSReadStream(compressed, uncompressedSize, DisposeAfterUse::YES);
+}
+
+template<class Format>
+void IndexedArchive<Format>::listFiles(Common::Array<Common::String> &filenames) {
+	for (ArchiveIndex::const_iterator it = _index.begin(); it != _index.end(); ++it)
+		filenames.push_back(it->_key);
+}
+
+template<class Format>
+uint32 IndexedArchive<Format>::getFileOffset(const Common::String &filename) {
+	ArchiveIndex::const_iterator it = _index.find(filename);
+	return (it != _index.end()) ? it->_value.offset : 0;
+}
+
+template<class Format>
+void IndexedArchive<Format>::readImageHeader(Common::ReadStream *stream, ImageHeader &header) {
+	byte data[IMAGE_HEADER_SIZE];
+	stream->read(data, IMAGE_HEADER_SIZE);
+	parseImageHeader<Format>(data, header);
+}
+
+Common::SeekableReadStream *ResourceArchive::openMember(const Common::String &filename, MemberInfo &info) {
+	Common::SeekableReadStream *stream = openFile(filename);
+	info.storedSize = info.expectedSize = info.decodedSize = stream ? stream->size() : 0;
+	info.partCount = 1;
+	return stream;
+}
+
+Common::SeekableReadStream *ResourceArchive::trackStream(Common::SeekableReadStream *stream, const Common::String &filename) {
+	if (!_memoryTracker || !stream)
+		return stream;
+
+	return new TrackedReadStream(stream, _memoryTracker, kMemArchive, filename);
+}
+
+template class IndexedArchive<PCFormat>;
+template class IndexedArchive<AmigaFormat>;
+template class IndexedArchive<DemoFormat>;
+
+// Subdirectories searched, as many as the game path gets in SearchMan
+static const int LOOSE_FILE_DEPTH = 4;
+
+// Files up to this size are kept in memory from their second open
+static const uint32 PIN_MAX_FILE_SIZE = 16 * 1024;
+static const uint32 PIN_MAX_BYTES = 256 * 1024;
+
+LooseFileArchive::LooseFileArchive(const Common::FSNode &directory, bool pinFiles) : _pinFiles(pinFiles), _pinnedBytes(0) {
+	addDirectory(directory, LOOSE_FILE_DEPTH);
+	debug(1, "Listed %d loose files", _files.size());
+}
+
+LooseFileArchive::~LooseFileArchive() {
+	for (LooseFileMap::iterator it = _files.begin(); it != _files.end(); ++it) {
+		if (_memoryTracker)
+			_memoryTracker->untrack(it->_value.pinnedData);
+		free(it->_value.pinnedData);
+	}
+}
+
+void LooseFileArchive::addDirectory(const Common::FSNode &directory, int depth) {
+	Common::FSList children;
+	if (!directory.getChildren(children, Common::FSNode::kListAll))
+		return;
+
+	for (uint32 i = 0; i < children.size(); i++) {
+		const Common::FSNode &node = children[i];
+
+		if (node.isDirectory()) {
+			if (depth > 1)
+				addDirectory(node, depth - 1);
+		} else if (!_files.contains(node.getName())) {
+			// Files nearer the top win, as in SearchMan
+			LooseFile file;
+			file.node = node;
+			file.openCount = 0;
+			file.pinnedData = 0;
+			file.pinnedSize = 0;
+			_files[node.getName()] = file;
+		}
+	}
+}
+
+Common::SeekableReadStream *LooseFileArchive::openFile(const Common::String &filename) {
+	LooseFileMap::iterator it = _files.find(filename);
+	if (it == _files.end())
+		return 0;
+
+	LooseFile &file = it->_value;
+	file.openCount++;
+
+	if (file.pinnedData)
+		return new Common::MemoryReadStream(file.pinnedData, file.pinnedSize);
+
+	Common::SeekableReadStream *stream = file.node.createReadStream();
+	if (!stream)
+		return 0;
+
+	if (_stats)
+		_stats->bytesRead += stream->size();
+
+	uint32 size = stream->size();
+	if (!_pinFiles || file.openCount < 2 || size > PIN_MAX_FILE_SIZE || _pinnedBytes + size > PIN_MAX_BYTES)
+		return stream;
+
+	file.pinnedData = (byte *)malloc(MAX<uint32>(size, 1));
+	file.pinnedSize = stream->read(file.pinnedData, size);
+	delete stream;
+
+	_pinnedBytes += file.pinnedSize;
+	if (_memoryTracker)
+		_memoryTracker->track(file.pinnedData, kMemArchive, filename, file.pinnedSize, true);
+
+	return new Common::MemoryReadStream(file.pinnedData, file.pinnedSize);
+}
+
+void LooseFileArchive::listFiles(Common::Array<Common::String> &filenames) {
+	for (LooseFileMap::const_iterator it = _files.begin(); it != _files.end(); ++it)
+		filenames.push_back(it->_key);
+}
+
+void LooseFileArchive::readImageHeader(Common::ReadStream *stream, ImageHeader &header) {
+	byte data[IMAGE_HEADER_SIZE];
+	stream->read(data, IMAGE_HEADER_SIZE);
+	parseImageHeader<PCFormat>(data, header);
+}
+
+template<class Format>
+static ResourceArchive *loadIndexedArchive(Common::SeekableReadStream *indexStream, Common::SeekableReadStream *dataStream) {
+	IndexedArchive<Format> *archive = new IndexedArchive<Format>(dataStream);
+
+	if (!archive->loadIndex(indexStream))
+		warning("The archive index has a truncated entry");
+
+	return archive;
+}
+
+ResourceArchive *createArchive(Common::SeekableReadStream *indexStream, Common::SeekableReadStream *dataStream, bool bigEndian, bool demoLayout) {
+	if (bigEndian)
+		return loadIndexedArchive<AmigaFormat>(indexStream, dataStream);
+	if (demoLayout)
+		return loadIndexedArchive<DemoFormat>(indexStream, dataStream);
+	return loadIndexedArchive<PCFormat>(indexStream, dataStream);
+}
+
+} // End of namespace StarTrek
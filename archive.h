@@ -0,0 +1,278 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_ARCHIVE_H
+#define STARTREK_ARCHIVE_H
+
+#include "common/array.h"
+#include "common/endian.h"
+#include "common/fs.h"
+#include "common/hash-str.h"
+#include "common/hashmap.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+#include "startrek/stats.h"
+
+namespace StarTrek {
+
+class Arena;
+class MemberCache;
+class MemoryTracker;
+
+struct ArchiveEntry {
+	uint32 offset;
+	uint16 fileCount;
+	uint16 size; // Only the demo index has the size, the others are 0
+};
+
+typedef Common::HashMap<Common::String, ArchiveEntry, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> ArchiveIndex;
+
+struct ImageHeader {
+	uint16 xoffset;
+	uint16 yoffset;
+	uint16 width;
+	uint16 height;
+};
+
+static const uint32 IMAGE_HEADER_SIZE = 8;
+static const uint32 MEMBER_HEADER_SIZE = 4;
+
+// Format traits. The PC and Macintosh versions share the little endian
+// layout, the Amiga version stores everything big endian and the ST25 demo
+// has a different index and uncompressed members.
+
+struct PCFormat {
+	static const uint32 kIndexEntrySize = 14;
+	static const bool kCompressed = true;
+
+	static uint16 readUint16(const byte *data) { return READ_LE_UINT16(data); }
+	static uint32 readUint24(const byte *data) { return data[0] | (data[1] << 8) | (data[2] << 16); }
+};
+
+struct AmigaFormat {
+	static const uint32 kIndexEntrySize = 14;
+	static const bool kCompressed = true;
+
+	static uint16 readUint16(const byte *data) { return READ_BE_UINT16(data); }
+	static uint32 readUint24(const byte *data) { return (data[0] << 16) | (data[1] << 8) | data[2]; }
+};
+
+struct DemoFormat {
+	static const uint32 kIndexEntrySize = 20;
+	static const bool kCompressed = false;
+
+	static uint16 readUint16(const byte *data) { return READ_LE_UINT16(data); }
+	static uint32 readUint24(const byte *data) { return PCFormat::readUint24(data); }
+};
+
+static inline Common::String readIndexName(const byte *entry) {
+	char name[13];
+	uint32 length = 0;
+
+	for (byte i = 0; i < 8 && entry[i]; i++)
+		name[length++] = entry[i];
+	name[length++] = '.';
+	for (byte i = 8; i < 11 && entry[i]; i++)
+		name[length++] = entry[i];
+
+	return Common::String(name, length);
+}
+
+template<class Format>
+inline void parseIndexEntry(const byte *entry, ArchiveEntry &archiveEntry) {
+	archiveEntry.offset = Format::readUint24(entry + 11);
+	archiveEntry.size = 0;
+
+	// Multi-part entries keep their part count in the upper bits
+	if (archiveEntry.offset & (1 << 23)) {
+		archiveEntry.fileCount = (archiveEntry.offset >> 16) & 0x7F;
+		archiveEntry.offset &= 0xFFFF;
+	} else {
+		archiveEntry.fileCount = 1;
+	}
+}
+
+template<>
+inline void parseIndexEntry<DemoFormat>(const byte *entry, ArchiveEntry &archiveEntry) {
+	// entry[11] is always 0
+	archiveEntry.fileCount = READ_LE_UINT16(entry + 12); // Always 1
+	archiveEntry.offset = READ_LE_UINT32(entry + 14);
+	archiveEntry.size = READ_LE_UINT16(entry + 18);
+}
+
+/**
+ * Parses a whole data.dir style index. The first entry of a name wins,
+ * as the original linear search did. Returns false on a truncated index.
+ */
+template<class Format>
+bool parseArchiveIndex(const byte *data, uint32 size, ArchiveIndex &index) {
+	uint32 pos = 0;
+
+	for (; pos + Format::kIndexEntrySize <= size; pos += Format::kIndexEntrySize) {
+		Common::String name = readIndexName(data + pos);
+		if (index.contains(name))
+			continue;
+
+		ArchiveEntry entry;
+		parseIndexEntry<Format>(data + pos, entry);
+		index[name] = entry;
+	}
+
+	return pos == size;
+}
+
+template<class Format>
+inline void parseImageHeader(const byte *data, ImageHeader &header) {
+	header.xoffset = Format::readUint16(data);
+	header.yoffset = Format::readUint16(data + 2);
+	header.width = Format::readUint16(data + 4);
+	header.height = Format::readUint16(data + 6);
+}
+
+template<class Format>
+inline void parseMemberHeader(const byte *data, uint16 &uncompressedSize, uint16 &compressedSize) {
+	uncompressedSize = Format::readUint16(data);
+	compressedSize = Format::readUint16(data + 2);
+}
+
+// Sizes of a member as stored and as decoded, for checking the archive
+struct MemberInfo {
+	uint32 storedSize;
+	uint32 expectedSize; // What the member header says it decodes to
+	uint32 decodedSize;
+	uint16 partCount; // Multi-part members are read as their parts joined
+};
+
+/**
+ * The game's resources. The implementation for the platform is chosen once
+ * at engine start, so none of the parsing has to check the platform.
+ */
+class ResourceArchive {
+public:
+	ResourceArchive() : _stats(0), _arena(0), _memoryTracker(0), _memberCache(0) {}
+	virtual ~ResourceArchive() {}
+
+	void setStats(EngineStats *stats) { _stats = stats; }
+	void setArena(Arena *arena) { _arena = arena; }
+	void setMemoryTracker(MemoryTracker *tracker) { _memoryTracker = tracker; }
+	void setMemberCache(MemberCache *cache) { _memberCache = cache; }
+	MemberCache *getMemberCache() const { return _memberCache; }
+
+	virtual bool hasFile(const Common::String &filename) = 0;
+	virtual Common::SeekableReadStream *openFile(const Common::String &filename) = 0; // 0 if missing
+	virtual void readImageHeader(Common::ReadStream *stream, ImageHeader &header) = 0;
+
+	// Position of the file in the data file, for reading files in order
+	virtual uint32 getFileOffset(const Common::String &filename) { return 0; }
+
+	virtual void listFiles(Common::Array<Common::String> &filenames) = 0;
+
+	// As openFile(), with the member's sizes, summed over the parts of a
+	// multi-part member
+	virtual Common::SeekableReadStream *openMember(const Common::String &filename, MemberInfo &info);
+
+	// For members read a piece at a time, such as movies. The stream reads
+	// from the data file as it goes instead of holding the whole member.
+	virtual Common::SeekableReadStream *openStreamingFile(const Common::String &filename) { return openFile(filename); }
+
+protected:
+	EngineStats *_stats;
+	Arena *_arena; // For decoding scratch memory
+	MemoryTracker *_memoryTracker;
+	MemberCache *_memberCache; // Decompressed members shared with other instances, if set
+
+	// Members read into memory are accounted for until they are deleted
+	Common::SeekableReadStream *trackStream(Common::SeekableReadStream *stream, const Common::String &filename);
+};
+
+/**
+ * An index file with a data file holding the members. The index is parsed
+ * into a hash map when the archive is loaded and the data file stays open.
+ */
+template<class Format>
+class IndexedArchive : public ResourceArchive {
+public:
+	IndexedArchive(Common::SeekableReadStream *dataStream) : _dataStream(dataStream) {}
+	~IndexedArchive() { delete _dataStream; }
+
+	bool loadIndex(Common::SeekableReadStream *indexStream);
+
+	bool hasFile(const Common::String &filename) { return _index.contains(filename); }
+	Common::SeekableReadStream *openFile(const Common::String &filename);
+	void readImageHeader(Common::ReadStream *stream, ImageHeader &header);
+	uint32 getFileOffset(const Common::String &filename);
+
+	void listFiles(Common::Array<Common::String> &filenames);
+	Common::SeekableReadStream *openMember(const Common::String &filename, MemberInfo &info);
+	Common::SeekableReadStream *openStreamingFile(const Common::String &filename);
+
+	const ArchiveIndex &getIndex() const { return _index; }
+
+private:
+	Common::SeekableReadStream *_dataStream;
+	ArchiveIndex _index;
+};
+
+/**
+ * Plain files on disk, as used by the Judgment Rites demo. The directory is
+ * listed once, so opening a file does not search the filesystem. Small
+ * files opened more than once can be kept in memory.
+ */
+class LooseFileArchive : public ResourceArchive {
+public:
+	LooseFileArchive(const Common::FSNode &directory, bool pinFiles);
+	~LooseFileArchive();
+
+	bool hasFile(const Common::String &filename) { return _files.contains(filename); }
+	Common::SeekableReadStream *openFile(const Common::String &filename);
+	void readImageHeader(Common::ReadStream *stream, ImageHeader &header);
+	void listFiles(Common::Array<Common::String> &filenames);
+
+	uint32 getFileCount() const { return _files.size(); }
+	uint32 getPinnedBytes() const { return _pinnedBytes; }
+
+private:
+	struct LooseFile {
+		Common::FSNode node;
+		uint32 openCount;
+		byte *pinnedData;
+		uint32 pinnedSize;
+	};
+
+	typedef Common::HashMap<Common::String, LooseFile, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> LooseFileMap;
+	LooseFileMap _files;
+	bool _pinFiles;
+	uint32 _pinnedBytes;
+
+	void addDirectory(const Common::FSNode &directory, int depth);
+};
+
+ResourceArchive *createArchive(Common::SeekableReadStream *indexStream, Common::SeekableReadStream *dataStream, bool bigEndian, bool demoLayout);
+
+} // End of namespace StarTrek
+
+#endif
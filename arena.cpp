@@ -0,0 +1,101 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/arena.h"
+
+#include "common/util.h"
+
+namespace StarTrek {
+
+static const uint32 ARENA_ALIGNMENT = 8;
+
+Arena::Arena(uint32 size) : _size(size) {
+	_block = (byte *)malloc(_size);
+	_used = 0;
+	_overflowBytes = 0;
+	_highWater = 0;
+	_peakHighWater = 0;
+	_totalOverflows = 0;
+}
+
+Arena::~Arena() {
+	reset();
+	free(_block);
+}
+
+void *Arena::allocate(uint32 size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+	void *data;
+
+	if (_used + size <= _size) {
+		data = _block + _used;
+		_used += size;
+	} else {
+		Overflow overflow;
+		overflow.data = data = malloc(size);
+		overflow.size = size;
+		_overflows.push_back(overflow);
+		_overflowBytes += size;
+		_totalOverflows++;
+	}
+
+	_highWater = MAX(_highWater, getUsed());
+	_peakHighWater = MAX(_peakHighWater, _highWater);
+	return data;
+}
+
+Arena::Mark Arena::getMark() const {
+	Mark mark;
+	mark.used = _used;
+	mark.overflowCount = _overflows.size();
+	return mark;
+}
+
+void Arena::release(const Mark &mark) {
+	while (_overflows.size() > mark.overflowCount) {
+		_overflowBytes -= _overflows.back().size;
+		free(_overflows.back().data);
+		_overflows.pop_back();
+	}
+
+	_used = mark.used;
+}
+
+void Arena::reset() {
+	Mark start = { 0, 0 };
+	release(start);
+
+	// Grow to what the scene needed, so the next one fits in the block
+	if (_highWater > _size) {
+		free(_block);
+		_size = (_highWater + 0xFFF) & ~0xFFF;
+		_block = (byte *)malloc(_size);
+	}
+
+	_highWater = 0;
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,105 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_ARENA_H
+#define STARTREK_ARENA_H
+
+#include "common/array.h"
+
+namespace StarTrek {
+
+/**
+ * Bump allocator for memory that does not outlive a scene. Allocations
+ * cannot be freed one by one; instead a mark is taken and released, or the
+ * whole arena is reset on a scene change.
+ *
+ * Allocations that do not fit the block go to the heap until the next
+ * reset. The block then grows to the scene's high-water mark, so it is
+ * only ever reallocated between scenes.
+ */
+class Arena {
+public:
+	struct Mark {
+		uint32 used;
+		uint32 overflowCount;
+	};
+
+	Arena(uint32 size);
+	~Arena();
+
+	void *allocate(uint32 size);
+
+	Mark getMark() const;
+	void release(const Mark &mark);
+	void reset();
+
+	uint32 getSize() const { return _size; }
+	uint32 getUsed() const { return _used + _overflowBytes; }
+	uint32 getHighWater() const { return _highWater; }
+	uint32 getPeakHighWater() const { return _peakHighWater; }
+	uint32 getOverflowCount() const { return _totalOverflows; }
+
+private:
+	byte *_block;
+	uint32 _size;
+	uint32 _used;
+
+	struct Overflow {
+		void *data;
+		uint32 size;
+	};
+	Common::Array<Overflow> _overflows;
+	uint32 _overflowBytes;
+
+	uint32 _highWater;     // Of the current scene
+	uint32 _peakHighWater; // Of all scenes
+	uint32 _totalOverflows;
+};
+
+/**
+ * Releases everything allocated from an arena during its lifetime.
+ * A null arena is allowed and does nothing.
+ */
+class ArenaScope {
+public:
+	ArenaScope(Arena *arena) : _arena(arena) {
+		if (_arena)
+			_mark = _arena->getMark();
+	}
+
+	~ArenaScope() {
+		if (_arena)
+			_arena->release(_mark);
+	}
+
+private:
+	Arena *_arena;
+	Arena::Mark _mark;
+};
+
+} // End of namespace StarTrek
+
+#endif
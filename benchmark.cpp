@@ -0,0 +1,288 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/archive.h"
+#include "startrek/benchmark.h"
+#include "startrek/lzss.h"
+#include "startrek/memtrack.h"
+#include "startrek/startrek.h"
+
+#include "common/endian.h"
+#include "common/file.h"
+#include "common/memstream.h"
+
+namespace StarTrek {
+
+// Each timed loop runs at least this long
+static const uint32 BENCHMARK_MIN_TIME = 200;
+static const uint32 BENCHMARK_DRAW_ITERATIONS = 20;
+
+// Members have 16-bit sizes, and the compressed size must fit as well
+static const uint32 MAX_MEMBER_SIZE = 0xF000;
+
+// Offsets are 24-bit, and bit 23 marks multi-part entries
+static const uint32 MAX_DATA_SIZE = 1 << 23;
+
+static const uint16 SYNTH_IMAGE_WIDTH = 320;
+static const uint16 SYNTH_IMAGE_HEIGHT = 200;
+
+static const char *const layoutNames[] = { "pc", "amiga", "demo" };
+
+static uint32 nextRandom(uint32 &seed) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+static void fillMember(byte *data, uint32 size, uint32 &seed) {
+	// Runs with some noise, which compresses about as well as the game's
+	// images do
+	uint32 pos = 0;
+	while (pos < size) {
+		uint32 value = nextRandom(seed);
+		if (value & 3) {
+			uint32 length = MIN<uint32>(1 + (value >> 2) % 24, size - pos);
+			memset(data + pos, value >> 8, length);
+			pos += length;
+		} else {
+			data[pos++] = value >> 8;
+		}
+	}
+}
+
+static void appendData(Common::Array<byte> &array, const byte *data, uint32 size) {
+	uint32 pos = array.size();
+	array.resize(pos + size);
+	memcpy(array.begin() + pos, data, size);
+}
+
+static void addMember(SyntheticArchive &archive, SyntheticLayout layout, const Common::String &name, const byte *data, uint32 size) {
+	uint32 offset = archive.data.size();
+	if (offset >= MAX_DATA_SIZE)
+		error("Synthetic archive is too large for 24-bit offsets");
+
+	byte entry[20];
+	memset(entry, 0, sizeof(entry));
+
+	// 8.3 name, padded with zeros
+	const char *dot = strchr(name.c_str(), '.');
+	uint32 baseLength = dot ? dot - name.c_str() : name.size();
+	memcpy(entry, name.c_str(), MIN<uint32>(baseLength, 8));
+	if (dot)
+		memcpy(entry + 8, dot + 1, MIN<uint32>(strlen(dot + 1), 3));
+
+	if (layout == kLayoutDemo) {
+		WRITE_LE_UINT16(entry + 12, 1);
+		WRITE_LE_UINT32(entry + 14, offset);
+		WRITE_LE_UINT16(entry + 18, size);
+		appendData(archive.index, entry, DemoFormat::kIndexEntrySize);
+		appendData(archive.data, data, size);
+	} else {
+		uint32 compressedSize;
+		byte *compressed = encodeLZSS(data, size, compressedSize);
+		if (compressedSize > 0xFFFF)
+			error("Synthetic member '%s' does not compress", name.c_str());
+		byte header[MEMBER_HEADER_SIZE];
+
+		if (layout == kLayoutAmiga) {
+			entry[11] = offset >> 16;
+			entry[12] = offset >> 8;
+			entry[13] = offset;
+			WRITE_BE_UINT16(header, size);
+			WRITE_BE_UINT16(header + 2, compressedSize);
+		} else {
+			entry[11] = offset;
+			entry[12] = offset >> 8;
+			entry[13] = offset >> 16;
+			WRITE_LE_UINT16(header, size);
+			WRITE_LE_UINT16(header + 2, compressedSize);
+		}
+
+		appendData(archive.index, entry, PCFormat::kIndexEntrySize);
+		appendData(archive.data, header, MEMBER_HEADER_SIZE);
+		appendData(archive.data, compressed, compressedSize);
+		free(compressed);
+	}
+
+	archive.names.push_back(name);
+	archive.uncompressedSize += size;
+}
+
+void generateSyntheticArchive(SyntheticLayout layout, uint32 memberCount, uint32 memberSize, SyntheticArchive &archive) {
+	archive.index.clear();
+	archive.data.clear();
+	archive.names.clear();
+	archive.uncompressedSize = 0;
+
+	uint32 seed = 1;
+	memberSize = MIN(memberSize, MAX_MEMBER_SIZE);
+
+	byte *member = (byte *)malloc(MAX<uint32>(memberSize, 1));
+	for (uint32 i = 0; i < memberCount; i++) {
+		fillMember(member, memberSize, seed);
+		addMember(archive, layout, Common::String::printf("SYN%05d.DAT", i), member, memberSize);
+	}
+	free(member);
+
+	// A full screen image in the layout's byte order
+	uint32 imageSize = IMAGE_HEADER_SIZE + SYNTH_IMAGE_WIDTH * SYNTH_IMAGE_HEIGHT;
+	byte *image = (byte *)malloc(imageSize);
+	if (layout == kLayoutAmiga) {
+		WRITE_BE_UINT16(image, 0);
+		WRITE_BE_UINT16(image + 2, 0);
+		WRITE_BE_UINT16(image + 4, SYNTH_IMAGE_WIDTH);
+		WRITE_BE_UINT16(image + 6, SYNTH_IMAGE_HEIGHT);
+	} else {
+		WRITE_LE_UINT16(image, 0);
+		WRITE_LE_UINT16(image + 2, 0);
+		WRITE_LE_UINT16(image + 4, SYNTH_IMAGE_WIDTH);
+		WRITE_LE_UINT16(image + 6, SYNTH_IMAGE_HEIGHT);
+	}
+	fillMember(image + IMAGE_HEADER_SIZE, imageSize - IMAGE_HEADER_SIZE, seed);
+	addMember(archive, layout, "SYNTH.BMP", image, imageSize);
+	free(image);
+
+	// 6-bit palette components, as in the PC files
+	byte palette[256 * 3];
+	for (uint32 i = 0; i < sizeof(palette); i++)
+		palette[i] = nextRandom(seed) & 0x3F;
+	addMember(archive, layout, "SYNTH.PAL", palette, sizeof(palette));
+}
+
+ArchiveBenchmark::ArchiveBenchmark(StarTrekEngine *vm) : _vm(vm) {
+	_memberCount = 1000;
+	_memberSize = 8192;
+}
+
+void ArchiveBenchmark::setMemberSize(uint32 size) {
+	_memberSize = CLIP<uint32>(size, 1, MAX_MEMBER_SIZE);
+}
+
+void ArchiveBenchmark::run(Common::Array<Common::String> &results) {
+	results.push_back(Common::String::printf("members=%d", _memberCount));
+	results.push_back(Common::String::printf("member_size=%d", _memberSize));
+
+	for (byte i = 0; i < kLayoutCount; i++)
+		runLayout((SyntheticLayout)i, results);
+}
+
+bool ArchiveBenchmark::writeResults(const Common::Array<Common::String> &results, const Common::String &filename) {
+	Common::DumpFile file;
+	if (!file.open(filename))
+		return false;
+
+	for (uint32 i = 0; i < results.size(); i++)
+		file.writeString(results[i] + "\n");
+
+	file.flush();
+	return !file.err();
+}
+
+void ArchiveBenchmark::runLayout(SyntheticLayout layout, Common::Array<Common::String> &results) {
+	const char *name = layoutNames[layout];
+
+	uint32 startTime = g_system->getMillis();
+	SyntheticArchive synth;
+	generateSyntheticArchive(layout, _memberCount, _memberSize, synth);
+	uint32 generateTime = g_system->getMillis() - startTime;
+
+	Common::MemoryReadStream indexStream(synth.index.begin(), synth.index.size());
+	Common::SeekableReadStream *dataStream = new Common::MemoryReadStream(synth.data.begin(), synth.data.size());
+
+	startTime = g_system->getMillis();
+	ResourceArchive *archive = createArchive(&indexStream, dataStream, layout == kLayoutAmiga, layout == kLayoutDemo);
+	uint32 indexTime = g_system->getMillis() - startTime;
+
+	// The generated archive and every member while it is open are counted
+	// by a tracker of the benchmark's own
+	MemoryTracker tracker;
+	tracker.track(synth.index.begin(), kMemArchive, "synthetic index", synth.index.size());
+	tracker.track(synth.data.begin(), kMemArchive, "synthetic data", synth.data.size());
+	archive->setMemoryTracker(&tracker);
+
+	// Index lookups
+	uint32 lookups = 0;
+	uint32 elapsed;
+	startTime = g_system->getMillis();
+	do {
+		for (uint32 i = 0; i < synth.names.size(); i++)
+			if (archive->hasFile(synth.names[i]))
+				lookups++;
+		elapsed = g_system->getMillis() - startTime;
+	} while (elapsed < BENCHMARK_MIN_TIME);
+	double lookupsPerSec = lookups * 1000.0 / elapsed;
+
+	// Opening members, which includes the LZSS decoding
+	double openedBytes = 0;
+	uint32 opened = 0;
+	startTime = g_system->getMillis();
+	do {
+		for (uint32 i = 0; i < synth.names.size(); i++) {
+			Common::SeekableReadStream *stream = archive->openFile(synth.names[i]);
+			openedBytes += stream->size();
+			opened++;
+			delete stream;
+		}
+		elapsed = g_system->getMillis() - startTime;
+	} while (elapsed < BENCHMARK_MIN_TIME);
+	double openMBPerSec = openedBytes * 1000.0 / elapsed / (1024 * 1024);
+	double openUsPerFile = elapsed * 1000.0 / opened;
+
+	// Drawing and palette setting go through the engine, so it has to use
+	// the synthetic archive for a while
+	ResourceArchive *engineArchive = _vm->_archive;
+	_vm->_archive = archive;
+
+	startTime = g_system->getMillis();
+	for (uint32 i = 0; i < BENCHMARK_DRAW_ITERATIONS; i++)
+		_vm->_gfx->drawImage("SYNTH.BMP");
+	double drawImageMs = (double)(g_system->getMillis() - startTime) / BENCHMARK_DRAW_ITERATIONS;
+
+	startTime = g_system->getMillis();
+	for (uint32 i = 0; i < BENCHMARK_DRAW_ITERATIONS; i++)
+		_vm->_gfx->setPalette("SYNTH.PAL");
+	double setPaletteMs = (double)(g_system->getMillis() - startTime) / BENCHMARK_DRAW_ITERATIONS;
+
+	_vm->_archive = engineArchive;
+	delete archive;
+
+	tracker.untrack(synth.index.begin());
+	tracker.untrack(synth.data.begin());
+	uint32 peakBytes = tracker.getPeakBytes(kMemArchive);
+
+	results.push_back(Common::String::printf("%s.generate_ms=%d", name, generateTime));
+	results.push_back(Common::String::printf("%s.index_bytes=%d", name, synth.index.size()));
+	results.push_back(Common::String::printf("%s.data_bytes=%d", name, synth.data.size()));
+	results.push_back(Common::String::printf("%s.compression_ratio=%.3f", name, (double)synth.data.size() / MAX<uint32>(synth.uncompressedSize, 1)));
+	results.push_back(Common::String::printf("%s.index_load_ms=%d", name, indexTime));
+	results.push_back(Common::String::printf("%s.lookups_per_sec=%.0f", name, lookupsPerSec));
+	results.push_back(Common::String::printf("%s.open_us_per_file=%.2f", name, openUsPerFile));
+	results.push_back(Common::String::printf("%s.open_mb_per_sec=%.2f", name, openMBPerSec));
+	results.push_back(Common::String::printf("%s.draw_image_ms=%.3f", name, drawImageMs));
+	results.push_back(Common::String::printf("%s.set_palette_ms=%.3f", name, setPaletteMs));
+	results.push_back(Common::String::printf("%s.peak_archive_bytes=%d", name, peakBytes));
+}
+
+} // End of namespace StarTrek
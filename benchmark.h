@@ -0,0 +1,82 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_BENCHMARK_H
+#define STARTREK_BENCHMARK_H
+
+#include "common/array.h"
+#include "common/str.h"
+
+namespace StarTrek {
+
+class StarTrekEngine;
+
+enum SyntheticLayout {
+	kLayoutPC = 0,
+	kLayoutAmiga,
+	kLayoutDemo,
+	kLayoutCount
+};
+
+/**
+ * A generated data.dir/data.001 pair. Besides the plain members there is
+ * an image, SYNTH.BMP, and a palette, SYNTH.PAL.
+ */
+struct SyntheticArchive {
+	Common::Array<byte> index;
+	Common::Array<byte> data;
+	Common::Array<Common::String> names;
+	uint32 uncompressedSize;
+};
+
+void generateSyntheticArchive(SyntheticLayout layout, uint32 memberCount, uint32 memberSize, SyntheticArchive &archive);
+
+/**
+ * Measures the resource path on generated archives, so none of the game's
+ * files are read. The engine still needs a detected game to start. Results
+ * are "<layout>.<metric>=<value>" lines.
+ */
+class ArchiveBenchmark {
+public:
+	ArchiveBenchmark(StarTrekEngine *vm);
+
+	void setMemberCount(uint32 count) { _memberCount = count; }
+	void setMemberSize(uint32 size);
+
+	void run(Common::Array<Common::String> &results);
+	static bool writeResults(const Common::Array<Common::String> &results, const Common::String &filename);
+
+private:
+	StarTrekEngine *_vm;
+	uint32 _memberCount;
+	uint32 _memberSize;
+
+	void runLayout(SyntheticLayout layout, Common::Array<Common::String> &results);
+};
+
+} // End of namespace StarTrek
+
+#endif
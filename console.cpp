@@ -0,0 +1,562 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "startrek/arena.h"
+#include "startrek/benchmark.h"
+#include "startrek/console.h"
+#include "startrek/font.h"
+#include "startrek/latency.h"
+#include "startrek/membercache.h"
+#include "startrek/memtrack.h"
+#include "startrek/midi.h"
+#include "startrek/mve.h"
+#include "startrek/prefetch.h"
+#include "startrek/selftest.h"
+#include "startrek/sound.h"
+#include "startrek/startrek.h"
+#include "startrek/verify.h"
+
+#include "sound/midiparser.h"
+
+namespace StarTrek {
+
+Console::Console(StarTrekEngine *vm) : GUI::Debugger(), _vm(vm) {
+	DCmd_Register("mvebench",         WRAP_METHOD(Console, Cmd_MveBench));
+	DCmd_Register("midibench",        WRAP_METHOD(Console, Cmd_MidiBench));
+	DCmd_Register("fontbench",        WRAP_METHOD(Console, Cmd_FontBench));
+	DCmd_Register("audiolatency",     WRAP_METHOD(Console, Cmd_AudioLatency));
+	DCmd_Register("startup",          WRAP_METHOD(Console, Cmd_Startup));
+	DCmd_Register("archivebench",     WRAP_METHOD(Console, Cmd_ArchiveBench));
+	DCmd_Register("stats",            WRAP_METHOD(Console, Cmd_Stats));
+	DCmd_Register("resstats",         WRAP_METHOD(Console, Cmd_ResourceStats));
+	DCmd_Register("gfxstats",         WRAP_METHOD(Console, Cmd_GraphicsStats));
+	DCmd_Register("sndstats",         WRAP_METHOD(Console, Cmd_SoundStats));
+	DCmd_Register("arena",            WRAP_METHOD(Console, Cmd_Arena));
+	DCmd_Register("scene",            WRAP_METHOD(Console, Cmd_Scene));
+	DCmd_Register("memory",           WRAP_METHOD(Console, Cmd_Memory));
+	DCmd_Register("prefetch",         WRAP_METHOD(Console, Cmd_Prefetch));
+	DCmd_Register("verify",           WRAP_METHOD(Console, Cmd_Verify));
+	DCmd_Register("palette",          WRAP_METHOD(Console, Cmd_Palette));
+	DCmd_Register("selftest",         WRAP_METHOD(Console, Cmd_SelfTest));
+}
+
+Console::~Console() {
+}
+
+bool Console::Cmd_MveBench(int argc, const char **argv) {
+	if (argc < 2) {
+		DebugPrintf("Usage: %s <movie>\n", argv[0]);
+		DebugPrintf("Decodes an MVE movie without audio or display and reports the frame rate\n");
+		return true;
+	}
+
+	MVEDecoder decoder(0);
+	decoder.setAudioEnabled(false);
+
+	if (!decoder.loadStream(_vm->openMovieStream(argv[1]))) {
+		DebugPrintf("Could not load '%s'\n", argv[1]);
+		return true;
+	}
+
+	uint32 startTime = g_system->getMillis();
+	while (!decoder.endOfVideo() && decoder.decodeNextFrame())
+		;
+	uint32 elapsed = MAX<uint32>(g_system->getMillis() - startTime, 1);
+
+	uint32 frames = decoder.getCurFrame();
+	uint32 fps100 = frames * 100000 / elapsed;
+	uint32 movieFps100 = 100000000 / MAX<uint32>(decoder.getFrameDelay(), 1);
+
+	DebugPrintf("%s: %dx%d, %d frames in %d ms\n", argv[1], decoder.getWidth(), decoder.getHeight(), frames, elapsed);
+	DebugPrintf("Decoded at %d.%02d fps (movie rate %d.%02d fps)\n", fps100 / 100, fps100 % 100, movieFps100 / 100, movieFps100 % 100);
+	return true;
+}
+
+bool Console::Cmd_MidiBench(int argc, const char **argv) {
+	if (argc < 2) {
+		DebugPrintf("Usage: %s <sound> [passes]\n", argv[0]);
+		DebugPrintf("Compares timer callback cost of the stock MIDI parser and the pre-parsed timeline\n");
+		return true;
+	}
+
+	Sound *sound = _vm->_sound;
+	if (!sound->initMidiDriver()) {
+		DebugPrintf("No MIDI music on this platform\n");
+		return true;
+	}
+
+	Common::String trackName = sound->getMusicTrackName(argv[1]);
+	if (trackName.empty()) {
+		DebugPrintf("No music for this device\n");
+		return true;
+	}
+
+	uint32 passes = (argc > 2) ? MAX(atoi(argv[2]), 1) : 10;
+	uint32 timerRate = sound->_midiDriver->getBaseTempo();
+
+	Common::SeekableReadStream *stream = sound->openMusicStream(trackName);
+	uint32 size = stream->size();
+	byte *data = (byte *)malloc(size);
+	stream->read(data, size);
+	delete stream;
+
+	uint32 startTime = g_system->getMillis();
+	MidiTimeline timeline;
+	bool loaded = sound->_useXMIDI ? loadXMIDITimeline(data, size, timeline) : loadSMFTimeline(data, size, timeline);
+	uint32 loadTime = g_system->getMillis() - startTime;
+
+	if (!loaded) {
+		DebugPrintf("Could not convert '%s'\n", trackName.c_str());
+		free(data);
+		return true;
+	}
+
+	// Both players get the same number of callbacks: the track's length
+	uint32 callbacks = timeline.getLength() / timerRate + 1;
+	NullMidiDriver nullDriver;
+
+	MidiParser *parser = sound->_useXMIDI ? MidiParser::createParser_XMIDI() : MidiParser::createParser_SMF();
+	parser->setMidiDriver(&nullDriver);
+	parser->setTimerRate(timerRate);
+
+	startTime = g_system->getMillis();
+	for (uint32 pass = 0; pass < passes; pass++) {
+		parser->loadMusic(data, size);
+		for (uint32 i = 0; i < callbacks; i++)
+			parser->onTimer();
+	}
+	uint32 parserTime = g_system->getMillis() - startTime;
+	uint32 parserMessages = nullDriver._messages;
+
+	parser->unloadMusic();
+	delete parser;
+
+	MidiTimelinePlayer player;
+	player.setMidiDriver(&nullDriver);
+	player.setTimerRate(timerRate);
+	nullDriver._messages = 0;
+
+	startTime = g_system->getMillis();
+	for (uint32 pass = 0; pass < passes; pass++) {
+		player.play(&timeline);
+		for (uint32 i = 0; i < callbacks; i++)
+			player.onTimer();
+	}
+	uint32 timelineTime = g_system->getMillis() - startTime;
+	uint32 timelineMessages = nullDriver._messages;
+
+	player.stop();
+	free(data);
+
+	uint32 totalCallbacks = callbacks * passes;
+	DebugPrintf("%s: %d events, %d callbacks per pass, %d passes\n", trackName.c_str(), timeline.events.size(), callbacks, passes);
+	DebugPrintf("Conversion:      %d ms (once per load)\n", loadTime);
+	DebugPrintf("Stock parser:    %d ms, %d ns per callback, %d messages\n", parserTime, (uint32)(parserTime * 1000000.0 / totalCallbacks), parserMessages);
+	DebugPrintf("Timeline player: %d ms, %d ns per callback, %d messages\n", timelineTime, (uint32)(timelineTime * 1000000.0 / totalCallbacks), timelineMessages);
+	return true;
+}
+
+// The byte per pixel glyphs as FONT.FNT has them, for comparison
+static void drawCharacterBytes(byte *dst, uint pitch, const byte *glyph) {
+	for (byte y = 0; y < Font::CHARACTER_HEIGHT; y++) {
+		for (byte x = 0; x < Font::CHARACTER_WIDTH; x++) {
+			if (glyph[x])
+				dst[x] = glyph[x];
+		}
+
+		glyph += Font::CHARACTER_WIDTH;
+		dst += pitch;
+	}
+}
+
+bool Console::Cmd_FontBench(int argc, const char **argv) {
+	Font *font = _vm->_gfx->getFont();
+	if (!font) {
+		DebugPrintf("This version has no FONT.FNT\n");
+		return true;
+	}
+
+	uint32 count = (argc > 1) ? MAX(atoi(argv[1]), 1) : 1000000;
+
+	const uint16 width = 320, height = 200;
+	const uint16 columns = width / Font::CHARACTER_WIDTH;
+	const uint16 rows = height / Font::CHARACTER_HEIGHT;
+	byte *screen = (byte *)calloc(width * height, 1);
+
+	const uint32 glyphSize = Font::CHARACTER_WIDTH * Font::CHARACTER_HEIGHT;
+	byte *glyphs = (byte *)malloc(0x80 * glyphSize);
+	for (uint16 i = 0; i < 0x80; i++)
+		font->unpackCharacter(i, glyphs + i * glyphSize);
+
+	// Printable characters over the whole screen, the same for both
+	uint32 startTime = g_system->getMillis();
+	for (uint32 i = 0; i < count; i++) {
+		uint32 cell = i % (columns * rows);
+		byte *dst = screen + (cell / columns) * Font::CHARACTER_HEIGHT * width + (cell % columns) * Font::CHARACTER_WIDTH;
+		drawCharacterBytes(dst, width, glyphs + (0x20 + i % 0x60) * glyphSize);
+	}
+	uint32 bytesTime = MAX<uint32>(g_system->getMillis() - startTime, 1);
+
+	startTime = g_system->getMillis();
+	for (uint32 i = 0; i < count; i++) {
+		uint32 cell = i % (columns * rows);
+		byte *dst = screen + (cell / columns) * Font::CHARACTER_HEIGHT * width + (cell % columns) * Font::CHARACTER_WIDTH;
+		font->drawCharacter(dst, width, 0x20 + i % 0x60);
+	}
+	uint32 packedTime = MAX<uint32>(g_system->getMillis() - startTime, 1);
+
+	free(glyphs);
+	free(screen);
+
+	DebugPrintf("Byte per pixel: %d characters in %d ms (%d chars/s), %d bytes of glyphs\n", count, bytesTime, (uint32)((double)count * 1000 / bytesTime), 0x80 * glyphSize);
+	DebugPrintf("Packed masks:   %d characters in %d ms (%d chars/s), %d bytes of glyphs\n", count, packedTime, (uint32)((double)count * 1000 / packedTime), 0x80 * 2 * Font::CHARACTER_HEIGHT);
+	return true;
+}
+
+bool Console::Cmd_AudioLatency(int argc, const char **argv) {
+	AudioLatency &latency = _vm->_sound->_latency;
+
+	if (argc > 1) {
+		if (!strcmp(argv[1], "reset")) {
+			latency.reset();
+			DebugPrintf("Audio latency histograms cleared\n");
+		} else if (!strcmp(argv[1], "export") && argc > 2) {
+			if (latency.exportToFile(argv[2]))
+				DebugPrintf("Exported to '%s'\n", argv[2]);
+			else
+				DebugPrintf("Could not write '%s'\n", argv[2]);
+		} else {
+			DebugPrintf("Usage: %s [reset | export <file>]\n", argv[0]);
+		}
+		return true;
+	}
+
+	for (byte i = 0; i < kLatencyCategoryCount; i++) {
+		LatencyHistogram histogram = latency.getHistogram((LatencyCategory)i);
+
+		if (!histogram.count) {
+			DebugPrintf("%s: no samples\n", AudioLatency::getCategoryName((LatencyCategory)i));
+			continue;
+		}
+
+		DebugPrintf("%s: %d samples, min %d us, avg %d us, max %d us\n", AudioLatency::getCategoryName((LatencyCategory)i),
+				histogram.count, histogram.min, (uint32)(histogram.total / histogram.count), histogram.max);
+
+		for (byte j = 0; j < NUM_LATENCY_BUCKETS; j++) {
+			if (!histogram.buckets[j])
+				continue;
+
+			if (j == 0)
+				DebugPrintf("  < 1 ms: %d\n", histogram.buckets[j]);
+			else if (j == NUM_LATENCY_BUCKETS - 1)
+				DebugPrintf("  >= %d ms: %d\n", AudioLatency::getBucketStart(j) / 1000, histogram.buckets[j]);
+			else
+				DebugPrintf("  %d-%d ms: %d\n", AudioLatency::getBucketStart(j) / 1000, AudioLatency::getBucketStart(j + 1) / 1000, histogram.buckets[j]);
+		}
+	}
+
+	DebugPrintf("Underruns: %d\n", latency.getUnderruns());
+	return true;
+}
+
+bool Console::Cmd_Startup(int argc, const char **argv) {
+	uint32 lastTime = 0;
+
+	for (uint32 i = 0; i < _vm->_startupTrace.size(); i++) {
+		const StarTrekEngine::StartupEvent &event = _vm->_startupTrace[i];
+		DebugPrintf("%6d ms (+%5d ms)  %s\n", event.time, event.time - lastTime, event.name.c_str());
+		lastTime = event.time;
+	}
+
+	return true;
+}
+
+bool Console::Cmd_ArchiveBench(int argc, const char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "help")) {
+		DebugPrintf("Usage: %s [members] [member size] [output file]\n", argv[0]);
+		DebugPrintf("Benchmarks the archive, LZSS and drawing code on generated PC, Amiga and demo archives\n");
+		return true;
+	}
+
+	ArchiveBenchmark benchmark(_vm);
+	if (argc > 1)
+		benchmark.setMemberCount(MAX(atoi(argv[1]), 1));
+	if (argc > 2)
+		benchmark.setMemberSize(atoi(argv[2]));
+
+	Common::Array<Common::String> results;
+	benchmark.run(results);
+
+	for (uint32 i = 0; i < results.size(); i++)
+		DebugPrintf("%s\n", results[i].c_str());
+
+	if (argc > 3 && !ArchiveBenchmark::writeResults(results, argv[3]))
+		DebugPrintf("Could not write '%s'\n", argv[3]);
+
+	return true;
+}
+
+// Hit rate in tenths of a percent
+static uint32 hitRate(uint32 hits, uint32 misses) {
+	return (hits + misses) ? (uint32)(hits * 1000.0 / (hits + misses)) : 0;
+}
+
+void Console::printResourceStats() {
+	const EngineStats *stats = _vm->getStats();
+	DebugPrintf("Resources opened:   %d\n", stats->resourcesOpened);
+	DebugPrintf("Bytes read:         %d\n", stats->bytesRead);
+	DebugPrintf("Bytes decompressed: %d\n", stats->bytesDecompressed);
+	DebugPrintf("Time waiting:       %d ms\n", stats->resourceWaitTime);
+	DebugPrintf("Files prefetched:   %d\n", stats->filesPrefetched);
+	DebugPrintf("Stalls avoided:     %d (%d ms recorded)\n", stats->prefetchHits, stats->prefetchTimeSaved);
+	DebugPrintf("Prefetches unused:  %d\n", stats->prefetchWasted);
+
+	const MemberCache *cache = _vm->getMemberCache();
+	if (cache)
+		DebugPrintf("Member cache:       %d hits, %d misses, %d stored\n", cache->getHits(), cache->getMisses(), cache->getStored());
+}
+
+void Console::printGraphicsStats() {
+	const EngineStats *stats = _vm->getStats();
+	DebugPrintf("Frames presented:   %d\n", stats->framesPresented);
+	DebugPrintf("Pixels uploaded:    %d\n", stats->pixelsUploaded);
+	DebugPrintf("Palette uploads:    %d\n", stats->paletteUploads);
+}
+
+void Console::printSoundStats() {
+	const EngineStats *stats = _vm->getStats();
+	Sound *sound = _vm->_sound;
+
+	uint32 activeVoices = 0;
+	for (byte i = 0; i < NUM_SFX_VOICES; i++)
+		if (_vm->_mixer->isSoundHandleActive(sound->_sfxVoices[i].handle))
+			activeVoices++;
+
+	uint32 sfxRate = hitRate(stats->sfxCacheHits, stats->sfxCacheMisses);
+	uint32 musicRate = hitRate(stats->musicBankHits, stats->musicBankMisses);
+
+	DebugPrintf("Active effect voices: %d of %d\n", activeVoices, NUM_SFX_VOICES);
+	DebugPrintf("Music playing:        %s\n", (_vm->_mixer->isSoundHandleActive(*sound->_soundHandle) || (sound->_midiPlayer && sound->_midiPlayer->isPlaying())) ? "yes" : "no");
+	DebugPrintf("Effect cache:         %d hits, %d misses (%d.%d%%)\n", stats->sfxCacheHits, stats->sfxCacheMisses, sfxRate / 10, sfxRate % 10);
+	DebugPrintf("Music bank:           %d hits, %d misses (%d.%d%%)\n", stats->musicBankHits, stats->musicBankMisses, musicRate / 10, musicRate % 10);
+	DebugPrintf("MIDI callbacks:       %d, %d events (see midibench for their cost)\n", stats->midiCallbacks, stats->midiEventsSent);
+}
+
+bool Console::Cmd_Stats(int argc, const char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "reset")) {
+		_vm->getStats()->resetResources();
+		_vm->getStats()->resetGraphics();
+		_vm->getStats()->resetAudio();
+		DebugPrintf("All counters cleared\n");
+		return true;
+	}
+
+	printResourceStats();
+	printGraphicsStats();
+	printSoundStats();
+	return true;
+}
+
+bool Console::Cmd_ResourceStats(int argc, const char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "reset"))
+		_vm->getStats()->resetResources();
+	else
+		printResourceStats();
+	return true;
+}
+
+bool Console::Cmd_GraphicsStats(int argc, const char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "reset"))
+		_vm->getStats()->resetGraphics();
+	else
+		printGraphicsStats();
+	return true;
+}
+
+bool Console::Cmd_SoundStats(int argc, const char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "reset"))
+		_vm->getStats()->resetAudio();
+	else
+		printSoundStats();
+	return true;
+}
+
+bool Console::Cmd_Arena(int argc, const char **argv) {
+	const Arena *arena = _vm->getSceneArena();
+
+	DebugPrintf("Scene '%s'\n", _vm->getSceneName().c_str());
+	DebugPrintf("Arena size:            %d bytes\n", arena->getSize());
+	DebugPrintf("In use:                %d bytes\n", arena->getUsed());
+	DebugPrintf("Scene high-water:      %d bytes\n", arena->getHighWater());
+	DebugPrintf("Peak high-water:       %d bytes\n", arena->getPeakHighWater());
+	DebugPrintf("Heap overflows:        %d\n", arena->getOverflowCount());
+	return true;
+}
+
+bool Console::Cmd_Scene(int argc, const char **argv) {
+	if (argc < 2) {
+		DebugPrintf("Current scene: '%s'\n", _vm->getSceneName().c_str());
+		DebugPrintf("Usage: %s <name> to start a new scene, which resets the scene arena\n", argv[0]);
+		return true;
+	}
+
+	_vm->changeScene(argv[1]);
+	return true;
+}
+
+bool Console::Cmd_Memory(int argc, const char **argv) {
+	const MemoryTracker *tracker = _vm->getMemoryTracker();
+
+	if (argc > 1 && strcmp(argv[1], "list") && strcmp(argv[1], "leaks")) {
+		DebugPrintf("Usage: %s [list|leaks]\n", argv[0]);
+		return true;
+	}
+
+	DebugPrintf("Subsystem     Live bytes    Peak bytes   Allocations\n");
+	for (byte i = 0; i < kMemSubsystemCount; i++) {
+		MemorySubsystem subsystem = (MemorySubsystem)i;
+		DebugPrintf("%-10s %13d %13d %13d\n", MemoryTracker::getSubsystemName(subsystem),
+				tracker->getLiveBytes(subsystem), tracker->getPeakBytes(subsystem), tracker->getAllocationCount(subsystem));
+	}
+
+	if (argc > 1) {
+		// Leaks are the allocations that outlived the scene they were made in
+		Common::Array<Common::String> lines;
+		tracker->listAllocations(lines, !strcmp(argv[1], "leaks"));
+
+		for (uint32 i = 0; i < lines.size(); i++)
+			DebugPrintf("%s\n", lines[i].c_str());
+		DebugPrintf("%d allocations\n", lines.size());
+	}
+
+	return true;
+}
+
+bool Console::Cmd_Prefetch(int argc, const char **argv) {
+	PrefetchManager *prefetch = _vm->getPrefetchManager();
+
+	if (argc >= 4 && !strcmp(argv[1], "build")) {
+		Common::Array<Common::String> logFiles;
+		for (int i = 3; i < argc; i++)
+			logFiles.push_back(argv[i]);
+
+		if (PrefetchManager::buildManifest(logFiles, argv[2]))
+			DebugPrintf("Wrote the manifest to '%s'\n", argv[2]);
+		else
+			DebugPrintf("Could not build the manifest\n");
+		return true;
+	}
+
+	if (argc >= 3 && !strcmp(argv[1], "load")) {
+		if (!prefetch->loadManifest(argv[2]))
+			DebugPrintf("Could not load '%s'\n", argv[2]);
+		return true;
+	}
+
+	if (argc >= 3 && !strcmp(argv[1], "record")) {
+		prefetch->startRecording(argv[2]);
+		return true;
+	}
+
+	if (argc >= 2 && !strcmp(argv[1], "stop")) {
+		prefetch->stopRecording();
+		return true;
+	}
+
+	if (argc > 1) {
+		DebugPrintf("Usage: %s [record <log>|stop|build <manifest> <log>...|load <manifest>]\n", argv[0]);
+		return true;
+	}
+
+	DebugPrintf("Recording:          %s\n", prefetch->isRecording() ? "yes" : "no");
+	DebugPrintf("Manifest loaded:    %s\n", prefetch->hasManifest() ? "yes" : "no");
+	DebugPrintf("Files queued:       %d\n", prefetch->getPendingCount());
+	DebugPrintf("Files warm:         %d (%d bytes)\n", prefetch->getWarmCount(), prefetch->getWarmBytes());
+	printResourceStats();
+	return true;
+}
+
+bool Console::Cmd_Verify(int argc, const char **argv) {
+	ArchiveVerifier verifier(_vm->getArchive());
+	if (argc > 1)
+		verifier.setExtractPath(argv[1]);
+
+	verifier.run();
+
+	// Only the totals and the bad members, the full list goes to the file
+	Common::Array<Common::String> report;
+	verifier.getReport(report);
+
+	for (uint32 i = 0; i < report.size(); i++) {
+		if (report[i].contains('=') || report[i].hasSuffix("corrupt"))
+			DebugPrintf("%s\n", report[i].c_str());
+	}
+
+	if (argc > 2 && !ArchiveBenchmark::writeResults(report, argv[2]))
+		DebugPrintf("Could not write '%s'\n", argv[2]);
+
+	return true;
+}
+
+bool Console::Cmd_Palette(int argc, const char **argv) {
+	PaletteEffects &effects = _vm->_gfx->getPaletteEffects();
+
+	if (argc >= 2 && !strcmp(argv[1], "fadeout")) {
+		uint16 frames = (argc > 2) ? atoi(argv[2]) : 50;
+		if (argc > 5)
+			effects.fadeOut(atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), frames);
+		else
+			effects.fadeOut(0, 0, 0, frames);
+	} else if (argc >= 2 && !strcmp(argv[1], "fadein")) {
+		effects.fadeIn((argc > 2) ? atoi(argv[2]) : 50);
+	} else if (argc >= 5 && !strcmp(argv[1], "flash")) {
+		effects.flash(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), (argc > 5) ? atoi(argv[5]) : 20);
+	} else if (argc >= 5 && !strcmp(argv[1], "cycle")) {
+		effects.addCycle(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), argc > 5 && !strcmp(argv[5], "reverse"));
+	} else if (argc >= 2 && !strcmp(argv[1], "stop")) {
+		effects.clearCycles();
+		effects.fadeIn(0);
+	} else {
+		DebugPrintf("Usage: %s fadeout [frames] [r g b] | fadein [frames] | flash <r> <g> <b> [frames]\n", argv[0]);
+		DebugPrintf("       %s cycle <start> <count> <delay> [reverse] | stop\n", argv[0]);
+		DebugPrintf("Fade level: %d of %d\n", effects.getFadeLevel(), FADE_STEPS);
+		return true;
+	}
+
+	// The effects run in the main loop, once the console is closed
+	return false;
+}
+
+bool Console::Cmd_SelfTest(int argc, const char **argv) {
+	Common::Array<Common::String> results;
+	uint32 failures = runSelfTests(results);
+
+	for (uint32 i = 0; i < results.size(); i++)
+		DebugPrintf("%s\n", results[i].c_str());
+	DebugPrintf("%d of %d checks failed\n", failures, results.size());
+	return true;
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,69 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef STARTREK_CONSOLE_H
+#define STARTREK_CONSOLE_H
+
+#include "gui/debugger.h"
+
+namespace StarTrek {
+
+class StarTrekEngine;
+
+class Console : public GUI::Debugger {
+public:
+	Console(StarTrekEngine *vm);
+	virtual ~Console(void);
+
+private:
+	StarTrekEngine *_vm;
+
+	bool Cmd_MveBench(int argc, const char **argv);
+	bool Cmd_MidiBench(int argc, const char **argv);
+	bool Cmd_FontBench(int argc, const char **argv);
+	bool Cmd_AudioLatency(int argc, const char **argv);
+	bool Cmd_Startup(int argc, const char **argv);
+	bool Cmd_ArchiveBench(int argc, const char **argv);
+	bool Cmd_Stats(int argc, const char **argv);
+	bool Cmd_ResourceStats(int argc, const char **argv);
+	bool Cmd_GraphicsStats(int argc, const char **argv);
+	bool Cmd_SoundStats(int argc, const char **argv);
+
+	bool Cmd_Arena(int argc, const char **argv);
+	bool Cmd_Scene(int argc, const char **argv);
+	bool Cmd_Memory(int argc, const char **argv);
+	bool Cmd_Prefetch(int argc, const char **argv);
+	bool Cmd_Verify(int argc, const char **argv);
+	bool Cmd_Palette(int argc, const char **argv);
+	bool Cmd_SelfTest(int argc, const char **argv);
+
+	void printResourceStats();
+	void printGraphicsStats();
+	void printSoundStats();
+};
+
+} // End of namespace StarTrek
+
+#endif
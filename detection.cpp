@@ -26,10 +26,15 @@
 #include "base/plugins.h"
 
 #include "engines/advancedDetector.h"
+#include "common/algorithm.h"
 #include "common/config-manager.h"
+#include "common/endian.h"
 #include "common/file.h"
+#include "common/md5.h"
+#include "common/savefile.h"
 
 #include "startrek/startrek.h"
+#include "startrek/savestate.h"
 
 namespace StarTrek {
 
@@ -182,6 +187,217 @@ static const StarTrekGameDescription gameDescriptions[] = {
 	{ AD_TABLE_END_MARKER, 0, 0, 0 }
 };
 
+// Number of bytes of the data file that are hashed
+static const uint32 DETECTION_MD5_BYTES = 5000;
+
+// Fallback detection
+
+static StarTrekGameDescription s_fallbackDesc;
+
+// A full index entry is an 8.3 name and a 24-bit offset. The ST25 demo adds
+// padding, a part count, a 32-bit offset and the file size.
+static const uint32 INDEX_ENTRY_SIZE = 14;
+static const uint32 DEMO_INDEX_ENTRY_SIZE = 20;
+
+// Number of entries whose structure is checked
+static const uint32 INDEX_PEEK_ENTRIES = 16;
+
+// Larger files are not the index of any release
+static const uint32 MAX_INDEX_SIZE = 256 * 1024;
+
+static bool isIndexNameChar(byte c) {
+	return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static bool isValidIndexEntry(const byte *entry, uint32 entrySize, uint32 dataSize, bool bigEndian) {
+	// Names are upper case and padded with zeros
+	for (byte i = 0; i < 11; i++) {
+		bool padded = (i < 8) ? (i > 0 && !entry[i]) : !entry[i];
+		bool pastPadding = (i > 0 && i != 8 && !entry[i - 1]);
+
+		if (padded)
+			continue;
+		if (pastPadding || !isIndexNameChar(entry[i]))
+			return false;
+	}
+
+	uint32 offset;
+
+	if (entrySize == DEMO_INDEX_ENTRY_SIZE) {
+		if (entry[11] || READ_LE_UINT16(entry + 12) != 1)
+			return false;
+		offset = READ_LE_UINT32(entry + 14);
+	} else {
+		if (bigEndian)
+			offset = (entry[11] << 16) | (entry[12] << 8) | entry[13];
+		else
+			offset = entry[11] | (entry[12] << 8) | (entry[13] << 16);
+
+		// Multi-part entries only keep the low 16 bits of the offset
+		if (offset & (1 << 23))
+			offset &= 0xFFFF;
+	}
+
+	return offset < dataSize;
+}
+
+// Only the first INDEX_PEEK_ENTRIES entries of the index have to be in memory
+static bool checkIndexLayout(const byte *index, uint32 size, uint32 entrySize, uint32 dataSize, bool bigEndian) {
+	if (!size || size % entrySize)
+		return false;
+
+	uint32 count = MIN(size / entrySize, INDEX_PEEK_ENTRIES);
+	for (uint32 i = 0; i < count; i++)
+		if (!isValidIndexEntry(index + i * entrySize, entrySize, dataSize, bigEndian))
+			return false;
+
+	return true;
+}
+
+static bool indexContains(const byte *index, uint32 size, uint32 entrySize, const char *name) {
+	for (uint32 pos = 0; pos + entrySize <= size; pos += entrySize) {
+		Common::String testfile;
+		for (byte i = 0; i < 8 && index[pos + i]; i++)
+			testfile += index[pos + i];
+		testfile += '.';
+		for (byte i = 8; i < 11 && index[pos + i]; i++)
+			testfile += index[pos + i];
+
+		if (testfile.equalsIgnoreCase(name))
+			return true;
+	}
+
+	return false;
+}
+
+static const Common::FSNode *findNode(const Common::FSList &fslist, const char *name) {
+	for (Common::FSList::const_iterator it = fslist.begin(); it != fslist.end(); ++it)
+		if (!it->isDirectory() && it->getName().equalsIgnoreCase(name))
+			return &*it;
+
+	return 0;
+}
+
+static bool findArchiveNodes(const Common::FSList &fslist, Common::Platform &platform, const Common::FSNode *&indexNode, const Common::FSNode *&dataNode) {
+	// Only the existence of the files is checked for the Macintosh version,
+	// its index is in the resource fork and there is only one release
+	if (findNode(fslist, "Star Trek Data")) {
+		platform = Common::kPlatformMacintosh;
+		indexNode = dataNode = 0;
+	} else if ((indexNode = findNode(fslist, "data000.dir")) && (dataNode = findNode(fslist, "data.000"))) {
+		platform = Common::kPlatformAmiga;
+	} else if ((indexNode = findNode(fslist, "data.dir")) && (dataNode = findNode(fslist, "data.001"))) {
+		platform = Common::kPlatformPC;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+static const ADGameDescription *detectFromIndex(const Common::FSList &fslist) {
+	Common::Platform platform;
+	const Common::FSNode *indexNode;
+	const Common::FSNode *dataNode;
+	uint8 gameType = GType_ST25;
+	uint32 features = 0;
+	bool ambiguous = false;
+
+	if (!findArchiveNodes(fslist, platform, indexNode, dataNode))
+		return 0;
+
+	if (indexNode) {
+		Common::File dataFile;
+		if (!dataFile.open(*dataNode))
+			return 0;
+		uint32 dataSize = dataFile.size();
+		dataFile.close();
+
+		Common::File indexFile;
+		if (!indexFile.open(*indexNode))
+			return 0;
+
+		// The whole index is read to tell the games apart by their files
+		uint32 indexSize = indexFile.size();
+		if (indexSize > MAX_INDEX_SIZE)
+			return 0;
+
+		byte *index = (byte *)malloc(MAX<uint32>(indexSize, 1));
+		indexFile.read(index, indexSize);
+		indexFile.close();
+
+		bool bigEndian = (platform == Common::kPlatformAmiga);
+		bool fullLayout = checkIndexLayout(index, indexSize, INDEX_ENTRY_SIZE, dataSize, bigEndian);
+		bool demoLayout = !bigEndian && checkIndexLayout(index, indexSize, DEMO_INDEX_ENTRY_SIZE, dataSize, false);
+
+		if (!fullLayout && !demoLayout) {
+			free(index);
+			return 0;
+		}
+
+		// A size that is a multiple of both entry sizes may pass both checks,
+		// in which case the hash below settles it
+		ambiguous = fullLayout && demoLayout;
+		if (!fullLayout)
+			features |= GF_DEMO;
+
+		uint32 entrySize = fullLayout ? INDEX_ENTRY_SIZE : DEMO_INDEX_ENTRY_SIZE;
+		if (indexContains(index, indexSize, entrySize, "BRIDGE.BGD") && !indexContains(index, indexSize, entrySize, "BRIDGE.BMP"))
+			gameType = GType_STJR;
+
+		free(index);
+	}
+
+	// Gather the known releases that fit what was found
+	const StarTrekGameDescription *candidates[ARRAYSIZE(gameDescriptions)];
+	uint32 candidateCount = 0;
+
+	for (const StarTrekGameDescription *g = gameDescriptions; g->desc.gameid; g++) {
+		if (g->desc.platform != platform || g->gameType != gameType)
+			continue;
+		if (!ambiguous && (g->features & GF_DEMO) != (features & GF_DEMO))
+			continue;
+		candidates[candidateCount++] = g;
+	}
+
+	const StarTrekGameDescription *match = (candidateCount == 1) ? candidates[0] : 0;
+
+	// Hash the data file only if the structure leaves more than one choice
+	if (candidateCount > 1 && dataNode) {
+		Common::File dataFile;
+		char md5str[32 + 1];
+
+		if (dataFile.open(*dataNode) && Common::md5_file_string(dataFile, md5str, DETECTION_MD5_BYTES)) {
+			for (uint32 i = 0; i < candidateCount && !match; i++)
+				if (!strcmp(candidates[i]->desc.filesDescriptions[0].md5, md5str))
+					match = candidates[i];
+
+			if (!match)
+				warning("Unknown Star Trek release, please report the MD5 of '%s': %s", dataNode->getName().c_str(), md5str);
+		}
+	}
+
+	if (match) {
+		s_fallbackDesc = *match;
+	} else {
+		// An unknown release; use the first candidate's files, if any
+		memset(&s_fallbackDesc, 0, sizeof(s_fallbackDesc));
+		if (candidateCount)
+			s_fallbackDesc = *candidates[0];
+		s_fallbackDesc.desc.gameid = (gameType == GType_STJR) ? "stjr" : "st25";
+		s_fallbackDesc.desc.extra = (features & GF_DEMO) ? "Demo" : "";
+		s_fallbackDesc.desc.language = candidateCount ? candidates[0]->desc.language : Common::UNK_LANG;
+		s_fallbackDesc.desc.platform = platform;
+		s_fallbackDesc.desc.flags = (features & GF_DEMO) ? ADGF_DEMO : ADGF_NO_FLAGS;
+		if (platform == Common::kPlatformMacintosh)
+			s_fallbackDesc.desc.flags |= ADGF_MACRESFORK;
+		s_fallbackDesc.gameType = gameType;
+		s_fallbackDesc.features = features & GF_DEMO;
+	}
+
+	return (const ADGameDescription *)&s_fallbackDesc;
+}
+
 } // End of namespace StarTrek
 
 static const ADParams detectionParams = {
@@ -190,7 +406,7 @@ static const ADParams detectionParams = {
 	// Size of that superset structure
 	sizeof(StarTrek::StarTrekGameDescription),
 	// Number of bytes to compute MD5 sum for
-	5000,
+	StarTrek::DETECTION_MD5_BYTES,
 	// List of all engine targets
 	starTrekGames,
 	// Structure for autoupgrading obsolete targets
@@ -221,9 +437,25 @@ public:
 		return "Star Trek: 25th Anniversary, Star Trek: Judgment Rites (C) Interplay";
 	}
 
+	virtual bool hasFeature(MetaEngineFeature f) const;
 	virtual bool createInstance(OSystem *syst, Engine **engine, const ADGameDescription *desc) const;
+	virtual const ADGameDescription *fallbackDetect(const Common::FSList &fslist) const;
+
+	virtual SaveStateList listSaves(const char *target) const;
+	virtual int getMaximumSaveSlot() const { return 999; }
+	virtual void removeSaveState(const char *target, int slot) const;
+	virtual SaveStateDescriptor querySaveMetaInfos(const char *target, int slot) const;
 };
 
+bool StarTrekMetaEngine::hasFeature(MetaEngineFeature f) const {
+	return (f == kSupportsListSaves) || (f == kSupportsLoadingDuringStartup) || (f == kSupportsDeleteSave) ||
+		(f == kSavesSupportMetaInfo) || (f == kSavesSupportThumbnail);
+}
+
+const ADGameDescription *StarTrekMetaEngine::fallbackDetect(const Common::FSList &fslist) const {
+	return StarTrek::detectFromIndex(fslist);
+}
+
 bool StarTrekMetaEngine::createInstance(OSystem *syst, Engine **engine, const ADGameDescription *desc) const {
 	const StarTrek::StarTrekGameDescription *gd = (const StarTrek::StarTrekGameDescription *)desc;
 	
@@ -232,6 +464,56 @@ bool StarTrekMetaEngine::createInstance(OSystem *syst, Engine **engine, const AD
 	return (gd != 0);
 }
 
+SaveStateList StarTrekMetaEngine::listSaves(const char *target) const {
+	Common::SaveFileManager *saveFileMan = g_system->getSavefileManager();
+	Common::StringArray filenames = saveFileMan->listSavefiles(Common::String(target) + ".???");
+	Common::sort(filenames.begin(), filenames.end());
+
+	SaveStateList saveList;
+	for (Common::StringArray::const_iterator file = filenames.begin(); file != filenames.end(); ++file) {
+		int slot = atoi(file->c_str() + file->size() - 3);
+		if (slot < 0 || slot > getMaximumSaveSlot())
+			continue;
+
+		Common::InSaveFile *in = saveFileMan->openForLoading(*file);
+		if (!in)
+			continue;
+
+		StarTrek::SaveHeader header;
+		if (StarTrek::SaveSnapshot::readHeader(in, header))
+			saveList.push_back(SaveStateDescriptor(slot, header.description));
+		delete in;
+	}
+
+	return saveList;
+}
+
+void StarTrekMetaEngine::removeSaveState(const char *target, int slot) const {
+	g_system->getSavefileManager()->removeSavefile(StarTrek::StarTrekEngine::getSaveStateName(target, slot));
+}
+
+SaveStateDescriptor StarTrekMetaEngine::querySaveMetaInfos(const char *target, int slot) const {
+	Common::InSaveFile *in = g_system->getSavefileManager()->openForLoading(StarTrek::StarTrekEngine::getSaveStateName(target, slot));
+	if (!in)
+		return SaveStateDescriptor();
+
+	StarTrek::SaveHeader header;
+	if (!StarTrek::SaveSnapshot::readHeader(in, header)) {
+		delete in;
+		return SaveStateDescriptor();
+	}
+
+	// The autosave slot can be loaded but neither overwritten nor deleted
+	bool autosave = (slot == StarTrek::StarTrekEngine::AUTOSAVE_SLOT);
+	SaveStateDescriptor desc(slot, header.description);
+	desc.setDeletableFlag(!autosave);
+	desc.setWriteProtectedFlag(autosave);
+	desc.setThumbnail(StarTrek::SaveSnapshot::readThumbnail(in));
+
+	delete in;
+	return desc;
+}
+
 #if PLUGIN_ENABLED_DYNAMIC(STARTREK)
 	REGISTER_PLUGIN_DYNAMIC(STARTREK, PLUGIN_TYPE_ENGINE, StarTrekMetaEngine);
 #else
@@ -24,38 +24,84 @@
  */
 
 #include "startrek/font.h"
+#include "startrek/memtrack.h"
+#include "startrek/startrek.h"
+
+#include "common/endian.h"
 
 namespace StarTrek {
 
 static const byte CHARACTER_COUNT = 0x80;
 static const byte CHARACTER_SIZE = 0x40;
 
+// Four pixels' worth of 0xFF for every 4-bit mask, built in memory order so
+// it works with native-endian 32-bit reads and writes
+static uint32 s_expandNibble[16];
+
+static void initExpandTable() {
+	for (byte i = 0; i < 16; i++) {
+		byte pixels[4];
+		for (byte j = 0; j < 4; j++)
+			pixels[j] = (i & (8 >> j)) ? 0xFF : 0;
+		s_expandNibble[i] = READ_UINT32(pixels);
+	}
+}
+
 Font::Font(StarTrekEngine *vm) : _vm(vm) {
 	Common::SeekableReadStream *fontStream = _vm->openFile("FONT.FNT");
 
 	_characters = new Character[CHARACTER_COUNT];
+	_vm->getMemoryTracker()->track(_characters, kMemFont, "FONT.FNT", CHARACTER_COUNT * sizeof(Character), true);
+
+	bool warned = false;
+	for (byte i = 0; i < CHARACTER_COUNT; i++) {
+		byte data[CHARACTER_SIZE];
+		fontStream->read(data, CHARACTER_SIZE);
+
+		for (byte y = 0; y < CHARACTER_HEIGHT; y++) {
+			byte foreground = 0, shadow = 0;
 
-	for (byte i = 0; i < CHARACTER_COUNT; i++)
-		fontStream->read(_characters[i].data, CHARACTER_SIZE);
+			for (byte x = 0; x < CHARACTER_WIDTH; x++) {
+				byte color = data[y * CHARACTER_WIDTH + x];
+				byte bit = 0x80 >> x;
+
+				if (color == FONT_SHADOW_COLOR) {
+					shadow |= bit;
+				} else if (color) {
+					if (color != FONT_FOREGROUND_COLOR && !warned) {
+						warning("Unexpected color %02x in FONT.FNT, drawn as foreground", color);
+						warned = true;
+					}
+					foreground |= bit;
+				}
+			}
+
+			_characters[i].foreground[y] = foreground;
+			_characters[i].shadow[y] = shadow;
+		}
+	}
 
 	delete fontStream;
 
+	if (!s_expandNibble[15])
+		initExpandTable();
+
 #if 0
 	// Code to dump the font
 	printf ("DUMPING FONT");
 	for (byte i = 0; i < CHARACTER_COUNT; i++) {
+		byte data[CHARACTER_SIZE];
+		unpackCharacter(i, data);
 		printf ("\n\nCHARACTER %02x (%d):\n", i, i);
 		for (byte j = 0; j < CHARACTER_SIZE; j++) {
 			if (!(j % 8))
 				printf ("\n");
-			if (_characters[i].data[j] == 0x7d)
+			if (data[j] == FONT_FOREGROUND_COLOR)
 				printf ("1 ");
-			else if (_characters[i].data[j] == 0x78)
+			else if (data[j] == FONT_SHADOW_COLOR)
 				printf ("0 ");
-			else if (_characters[i].data[j] == 0)
-				printf ("  ");
 			else
-				printf ("? ");
+				printf ("  ");
 		}
 	}
 	printf("\n\n");
@@ -63,7 +109,56 @@ Font::Font(StarTrekEngine *vm) : _vm(vm) {
 }
 
 Font::~Font() {
+	_vm->getMemoryTracker()->untrack(_characters);
 	delete[] _characters;
 }
 
+void Font::drawCharacter(byte *dst, uint pitch, byte c) const {
+	const Character &character = _characters[c & (CHARACTER_COUNT - 1)];
+	const uint32 foregroundColor = FONT_FOREGROUND_COLOR * 0x01010101;
+	const uint32 shadowColor = FONT_SHADOW_COLOR * 0x01010101;
+
+	// Each row is two 4-pixel words: the masks select which bytes take the
+	// glyph's colors and which keep what is on the screen
+	for (byte y = 0; y < CHARACTER_HEIGHT; y++) {
+		byte foreground = character.foreground[y];
+		byte shadow = character.shadow[y];
+
+		for (byte half = 0; half < 2; half++) {
+			uint32 foregroundMask = s_expandNibble[half ? (foreground & 0xF) : (foreground >> 4)];
+			uint32 shadowMask = s_expandNibble[half ? (shadow & 0xF) : (shadow >> 4)];
+			byte *pixels = dst + half * 4;
+
+			if (foregroundMask | shadowMask) {
+				uint32 value = READ_UINT32(pixels) & ~(foregroundMask | shadowMask);
+				WRITE_UINT32(pixels, value | (foregroundColor & foregroundMask) | (shadowColor & shadowMask));
+			}
+		}
+
+		dst += pitch;
+	}
+}
+
+void Font::drawText(byte *dst, uint pitch, const char *text) const {
+	for (; *text; text++, dst += CHARACTER_WIDTH)
+		drawCharacter(dst, pitch, *text);
+}
+
+void Font::unpackCharacter(byte c, byte *pixels) const {
+	const Character &character = _characters[c & (CHARACTER_COUNT - 1)];
+
+	for (byte y = 0; y < CHARACTER_HEIGHT; y++) {
+		for (byte x = 0; x < CHARACTER_WIDTH; x++) {
+			byte bit = 0x80 >> x;
+
+			if (character.foreground[y] & bit)
+				*pixels++ = FONT_FOREGROUND_COLOR;
+			else if (character.shadow[y] & bit)
+				*pixels++ = FONT_SHADOW_COLOR;
+			else
+				*pixels++ = 0;
+		}
+	}
+}
+
 }
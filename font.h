@@ -32,16 +32,36 @@ namespace StarTrek {
 
 class StarTrekEngine;
 
+// The only colors FONT.FNT uses, besides transparency
+static const byte FONT_FOREGROUND_COLOR = 0x7D;
+static const byte FONT_SHADOW_COLOR = 0x78;
+
+/**
+ * The 8x8 PC font. FONT.FNT has a byte per pixel, but only ever the
+ * foreground and shadow colors or 0 for transparent, so each glyph is kept
+ * as one bit per pixel in two masks, the leftmost pixel in the top bit.
+ */
 class Font {
 public:
 	Font(StarTrekEngine *vm);
 	~Font();
-	
+
+	static const byte CHARACTER_WIDTH = 8;
+	static const byte CHARACTER_HEIGHT = 8;
+
+	// Draws over what is there, transparent pixels are left alone
+	void drawCharacter(byte *dst, uint pitch, byte c) const;
+	void drawText(byte *dst, uint pitch, const char *text) const;
+
+	// Back to a byte per pixel, as in the file
+	void unpackCharacter(byte c, byte *pixels) const;
+
 private:
 	StarTrekEngine *_vm;
 
 	struct Character {
-		byte data[0x40];
+		byte foreground[CHARACTER_HEIGHT];
+		byte shadow[CHARACTER_HEIGHT];
 	} *_characters;
 };
 
@@ -23,35 +23,125 @@
  *
  */
 
+#include "startrek/arena.h"
+#include "startrek/archive.h"
 #include "startrek/graphics.h"
+#include "startrek/memtrack.h"
 
 #include "common/config-manager.h"
 
+#include "graphics/surface.h"
+
 namespace StarTrek {
 
+static const uint16 SCREEN_WIDTH = 320;
+static const uint16 SCREEN_HEIGHT = 200;
+
 Graphics::Graphics(StarTrekEngine *vm) : _vm(vm), _egaMode(false) {
 	_font = 0;
 	_egaData = 0;
+	memset(_screenPalette, 0, sizeof(_screenPalette));
+	_screenPaletteValid = false;
+	_screenGeneration = 0;
 
 	if (ConfMan.hasKey("render_mode"))
 		_egaMode = (Common::parseRenderMode(ConfMan.get("render_mode").c_str()) == Common::kRenderEGA) && (_vm->getGameType() != GType_STJR) && !(_vm->getFeatures() & GF_DEMO);
+}
 
-	if (_vm->getGameType() == GType_ST25 && _vm->getPlatform() == Common::kPlatformPC)
+Font *Graphics::getFont() {
+	// Only the PC version of ST25 has FONT.FNT. It is loaded when text is
+	// first drawn rather than at startup.
+	if (!_font && _vm->getGameType() == GType_ST25 && _vm->getPlatform() == Common::kPlatformPC) {
 		_font = new Font(_vm);
+		_vm->traceStartup("Font loaded");
+	}
+
+	return _font;
 }
 
 Graphics::~Graphics() {
-	if (_egaData)
-		free(_egaData);
-
+	MemoryTracker *tracker = _vm->getMemoryTracker();
+	tracker->release(_egaData);
 	delete _font;
 }
 
+void Graphics::setScreenPalette(const byte *palette, uint start, uint count) {
+	memcpy(_screenPalette + start * 4, palette, count * 4);
+	if (start == 0 && count == PALETTE_COLORS)
+		_screenPaletteValid = true;
+
+	_vm->_system->setPalette(palette, start, count);
+	_vm->getStats()->paletteUploads++;
+	_screenGeneration++;
+}
+
+void Graphics::copyToScreen(const byte *buf, int pitch, int x, int y, int w, int h) {
+	_vm->_system->copyRectToScreen(buf, pitch, x, y, w, h);
+	_vm->getStats()->pixelsUploaded += w * h;
+	_screenGeneration++;
+}
+
+void Graphics::updateScreen() {
+	_vm->_system->updateScreen();
+	_vm->getStats()->framesPresented++;
+}
+
+void Graphics::uploadPalette(const byte *palette) {
+	// What the backend starts with is unknown, so the first one goes whole
+	if (!_screenPaletteValid) {
+		setScreenPalette(palette, 0, PALETTE_COLORS);
+		return;
+	}
+
+	// Only the runs of entries that differ from the screen's
+	uint16 i = 0;
+	while (i < PALETTE_COLORS) {
+		if (!memcmp(palette + i * 4, _screenPalette + i * 4, 3)) {
+			i++;
+			continue;
+		}
+
+		uint16 start = i;
+		while (i < PALETTE_COLORS && memcmp(palette + i * 4, _screenPalette + i * 4, 3))
+			i++;
+
+		setScreenPalette(palette + start * 4, start, i - start);
+	}
+}
+
+void Graphics::updatePaletteEffects() {
+	if (!_paletteEffects.update())
+		return;
+
+	uploadPalette(_paletteEffects.getPalette());
+	updateScreen();
+}
+
+void Graphics::refreshPalette() {
+	uploadPalette(_paletteEffects.getPalette());
+	updateScreen();
+}
+
+void Graphics::drawText(const char *text, int x, int y) {
+	Font *font = getFont();
+	if (!font || x < 0 || y < 0 || x >= SCREEN_WIDTH || y + Font::CHARACTER_HEIGHT > SCREEN_HEIGHT)
+		return;
+
+	// Only whole characters are drawn
+	Common::String clipped(text, MIN<uint32>(strlen(text), (SCREEN_WIDTH - x) / Font::CHARACTER_WIDTH));
+
+	::Graphics::Surface *screen = _vm->_system->lockScreen();
+	font->drawText((byte *)screen->getBasePtr(x, y), screen->pitch, clipped.c_str());
+	_vm->_system->unlockScreen();
+	_screenGeneration++;
+}
+
 void Graphics::setPalette(const char *paletteFile) {
 	// Set the palette from a PAL file
 
 	Common::SeekableReadStream *palStream = _vm->openFile(paletteFile);
-	byte *palette = (byte *)malloc(256 * 4);
+	ArenaScope scope(_vm->getSceneArena());
+	byte *palette = (byte *)_vm->getSceneArena()->allocate(256 * 4);
 	for (uint16 i = 0; i < 256; i++) {
 		palette[i * 4] = palStream->readByte();
 		palette[i * 4 + 1] = palStream->readByte();
@@ -65,8 +155,8 @@ void Graphics::setPalette(const char *paletteFile) {
 			for (byte j = 0; j < 3; j++)
 				palette[i * 4 + j] = palette[i * 4 + j] << 2;
 
-	_vm->_system->setPalette(palette, 0, 256);
-	free(palette);
+	_paletteEffects.setBasePalette(palette, 0, 256);
+	uploadPalette(_paletteEffects.getPalette());
 	delete palStream;
 }
 
@@ -76,7 +166,7 @@ void Graphics::loadEGAData(const char *filename) {
 		return;
 
 	if (!_egaData)
-		_egaData = (byte *)malloc(256);
+		_egaData = (byte *)_vm->getMemoryTracker()->allocate(kMemGraphics, filename, 256, true);
 
 	Common::SeekableReadStream *egaStream = _vm->openFile(filename);
 	egaStream->read(_egaData, 256);
@@ -87,12 +177,15 @@ void Graphics::drawImage(const char *filename) {
 	// Draw a regular bitmap
 
 	Common::SeekableReadStream *imageStream = _vm->openFile(filename);
-	uint16 xoffset = (_vm->getPlatform() == Common::kPlatformAmiga) ? imageStream->readUint16BE() : imageStream->readUint16LE();
-	uint16 yoffset = (_vm->getPlatform() == Common::kPlatformAmiga) ? imageStream->readUint16BE() : imageStream->readUint16LE();
-	uint16 width = (_vm->getPlatform() == Common::kPlatformAmiga) ? imageStream->readUint16BE() : imageStream->readUint16LE();
-	uint16 height = (_vm->getPlatform() == Common::kPlatformAmiga) ? imageStream->readUint16BE() : imageStream->readUint16LE();	
+	ImageHeader header;
+	_vm->getArchive()->readImageHeader(imageStream, header);
+	uint16 xoffset = header.xoffset;
+	uint16 yoffset = header.yoffset;
+	uint16 width = header.width;
+	uint16 height = header.height;
 
-	byte *pixels = (byte *)malloc(width * height);
+	ArenaScope scope(_vm->getSceneArena());
+	byte *pixels = (byte *)_vm->getSceneArena()->allocate(width * height);
 
 	if (_egaMode && _egaData) {
 		// FIXME: This doesn't work right
@@ -102,15 +195,18 @@ void Graphics::drawImage(const char *filename) {
 		imageStream->read(pixels, width * height);
 	}
 
-	_vm->_system->copyRectToScreen(pixels, width, xoffset, yoffset, width, height);
-	_vm->_system->updateScreen();
+	delete imageStream;
+
+	copyToScreen(pixels, width, xoffset, yoffset, width, height);
+	updateScreen();
 }
 
 void Graphics::drawBackgroundImage(const char *filename) {
 	// Draw an stjr BGD image (palette built-in)
 
 	Common::SeekableReadStream *imageStream = _vm->openFile(filename);
-	byte *palette = (byte *)malloc(256 * 4);
+	ArenaScope scope(_vm->getSceneArena());
+	byte *palette = (byte *)_vm->getSceneArena()->allocate(256 * 4);
 	for (uint16 i = 0; i < 256; i++) {
 		palette[i * 4] = imageStream->readByte();
 		palette[i * 4 + 1] = imageStream->readByte();
@@ -123,19 +219,21 @@ void Graphics::drawBackgroundImage(const char *filename) {
 		for (byte j = 0; j < 3; j++)
 			palette[i * 4 + j] = palette[i * 4 + j] << 2;
 
-	uint16 xoffset = imageStream->readUint16LE();
-	uint16 yoffset = imageStream->readUint16LE();
-	uint16 width = imageStream->readUint16LE();
-	uint16 height = imageStream->readUint16LE();	
+	ImageHeader header;
+	_vm->getArchive()->readImageHeader(imageStream, header);
+	uint16 xoffset = header.xoffset;
+	uint16 yoffset = header.yoffset;
+	uint16 width = header.width;
+	uint16 height = header.height;
 
-	byte *pixels = (byte *)malloc(width * height);
+	byte *pixels = (byte *)_vm->getSceneArena()->allocate(width * height);
 	imageStream->read(pixels, width * height);
 
-	_vm->_system->setPalette(palette, 0, 256);
-	_vm->_system->copyRectToScreen(pixels, width, xoffset, yoffset, width, height);
-	_vm->_system->updateScreen();
+	_paletteEffects.setBasePalette(palette, 0, 256);
+	uploadPalette(_paletteEffects.getPalette());
+	copyToScreen(pixels, width, xoffset, yoffset, width, height);
+	updateScreen();
 
-	free(palette);
 	delete imageStream;
 }
 
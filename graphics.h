@@ -28,6 +28,7 @@
 
 #include "startrek/startrek.h"
 #include "startrek/font.h"
+#include "startrek/palette.h"
 
 namespace StarTrek {
 
@@ -43,7 +44,25 @@ public:
 	void loadEGAData(const char *egaFile);
 	void drawImage(const char *filename);
 	void drawBackgroundImage(const char *filename);
-	
+
+	Font *getFont();
+	void drawText(const char *text, int x, int y);
+
+	// Fades and cycles apply to the palettes loaded by setPalette() and
+	// drawBackgroundImage(); updatePaletteEffects() advances them a frame
+	PaletteEffects &getPaletteEffects() { return _paletteEffects; }
+	void updatePaletteEffects();
+	void refreshPalette(); // After the effects' state or the screen palette was replaced
+	void invalidateScreenPalette() { _screenPaletteValid = false; } // After a video mode switch
+
+	// All screen updates go through these, so they can be counted
+	void setScreenPalette(const byte *palette, uint start, uint count);
+	void copyToScreen(const byte *buf, int pitch, int x, int y, int w, int h);
+	void updateScreen();
+
+	// Changes whenever the screen contents or its palette do, whether or
+	// not a frame has been presented since
+	uint32 getScreenGeneration() const { return _screenGeneration; }
 	
 private:
 	StarTrekEngine *_vm;
@@ -51,6 +70,12 @@ private:
 	
 	bool _egaMode;
 	byte *_egaData;
+
+	PaletteEffects _paletteEffects;
+	byte _screenPalette[PALETTE_COLORS * 4]; // As last uploaded
+	bool _screenPaletteValid;
+	uint32 _screenGeneration;
+	void uploadPalette(const byte *palette);
 };
 
 }
@@ -0,0 +1,205 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/input.h"
+#include "startrek/startrek.h"
+
+#include "common/util.h"
+
+namespace StarTrek {
+
+InputRecorder::InputRecorder(StarTrekEngine *vm) : _vm(vm), _mode(kInputLive) {
+	_tick = 0;
+	_startTime = 0;
+	_nextEvent = 0;
+	_tickCount = 0;
+	_spanStartTime = 0;
+	_spanTicks = 0;
+	_spanEvents = 0;
+	_totalTime = 0;
+}
+
+InputRecorder::~InputRecorder() {
+	stop();
+}
+
+bool InputRecorder::startRecording(const Common::String &filename) {
+	stop();
+
+	if (!_recording.open(filename)) {
+		warning("Could not open input recording '%s'", filename.c_str());
+		return false;
+	}
+
+	_mode = kInputRecord;
+	_tick = 0;
+	_startTime = g_system->getMillis();
+	return true;
+}
+
+bool InputRecorder::startReplay(const Common::String &filename, const Common::String &reportFilename) {
+	stop();
+
+	Common::File file;
+	if (!file.open(filename)) {
+		warning("Could not open input recording '%s'", filename.c_str());
+		return false;
+	}
+
+	_events.clear();
+	_tickCount = 0;
+
+	while (!file.eos() && !file.err()) {
+		Common::String line = file.readLine();
+		int values[8];
+
+		if (sscanf(line.c_str(), "event\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d", &values[0], &values[1], &values[2], &values[3], &values[4], &values[5], &values[6], &values[7]) == 8) {
+			RecordedEvent recordedEvent;
+			recordedEvent.tick = values[0];
+			recordedEvent.time = values[1];
+			recordedEvent.event.type = (Common::EventType)values[2];
+			recordedEvent.event.kbd.keycode = (Common::KeyCode)values[3];
+			recordedEvent.event.kbd.ascii = values[4];
+			recordedEvent.event.kbd.flags = values[5];
+			recordedEvent.event.mouse.x = values[6];
+			recordedEvent.event.mouse.y = values[7];
+			_events.push_back(recordedEvent);
+		} else if (sscanf(line.c_str(), "end\t%d", &values[0]) == 1) {
+			_tickCount = values[0];
+		}
+	}
+
+	if (!_tickCount && !_events.empty())
+		_tickCount = _events.back().tick + 1;
+
+	if (!_report.open(reportFilename)) {
+		warning("Could not open replay report '%s'", reportFilename.c_str());
+		return false;
+	}
+
+	_report.writeString("first_tick,ticks,virtual_ms,wall_ms,us_per_tick,elapsed_ms,events,resources_opened,resource_wait_ms,bytes_read,bytes_decompressed,files_prefetched\n");
+
+	_mode = kInputReplay;
+	_tick = 0;
+	_nextEvent = 0;
+	_totalTime = 0;
+	_spanTicks = 0;
+	_spanEvents = 0;
+	_spanStartTime = g_system->getMillis();
+	_spanStartStats = *_vm->getStats();
+	return true;
+}
+
+void InputRecorder::stop() {
+	if (_mode == kInputRecord) {
+		_recording.writeString(Common::String::printf("end\t%d\n", _tick));
+		_recording.flush();
+		_recording.close();
+	} else if (_mode == kInputReplay) {
+		if (_spanTicks)
+			writeReportSpan();
+		_report.flush();
+		_report.close();
+		debug(1, "Replayed %d ticks in %d ms", _tick, _totalTime);
+	}
+
+	_mode = kInputLive;
+}
+
+uint32 InputRecorder::getTime() const {
+	if (_mode == kInputReplay)
+		return _tick * TICK_MILLIS;
+
+	return g_system->getMillis() - _startTime;
+}
+
+bool InputRecorder::pollEvent(Common::Event &event) {
+	Common::EventManager *eventMan = g_system->getEventManager();
+
+	if (_mode != kInputReplay) {
+		if (!eventMan->pollEvent(event))
+			return false;
+
+		if (_mode == kInputRecord) {
+			_recording.writeString(Common::String::printf("event\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", _tick, getTime(), event.type,
+					event.kbd.keycode, event.kbd.ascii, event.kbd.flags, event.mouse.x, event.mouse.y));
+		}
+
+		return true;
+	}
+
+	// Live input would make the run differ, but quitting is still allowed
+	Common::Event liveEvent;
+	while (eventMan->pollEvent(liveEvent)) {
+		if (liveEvent.type == Common::EVENT_QUIT || liveEvent.type == Common::EVENT_RTL) {
+			event = liveEvent;
+			return true;
+		}
+	}
+
+	if (_nextEvent < _events.size() && _events[_nextEvent].tick <= _tick) {
+		event = _events[_nextEvent++].event;
+		return true;
+	}
+
+	return false;
+}
+
+void InputRecorder::endTick() {
+	if (_mode == kInputReplay) {
+		for (uint32 i = _nextEvent; i > 0 && _events[i - 1].tick == _tick; i--)
+			_spanEvents++;
+		_spanTicks++;
+	}
+
+	_tick++;
+
+	if (_mode == kInputReplay && _spanTicks == REPORT_SPAN_TICKS)
+		writeReportSpan();
+}
+
+void InputRecorder::writeReportSpan() {
+	const EngineStats *stats = _vm->getStats();
+	uint32 now = g_system->getMillis();
+	uint32 wallTime = now - _spanStartTime;
+
+	_totalTime += wallTime;
+
+	_report.writeString(Common::String::printf("%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", _tick - _spanTicks, _spanTicks, getTime(), wallTime,
+			wallTime * 1000 / _spanTicks, _totalTime, _spanEvents,
+			stats->resourcesOpened - _spanStartStats.resourcesOpened,
+			stats->resourceWaitTime - _spanStartStats.resourceWaitTime,
+			stats->bytesRead - _spanStartStats.bytesRead,
+			stats->bytesDecompressed - _spanStartStats.bytesDecompressed,
+			stats->filesPrefetched - _spanStartStats.filesPrefetched));
+
+	_spanStartTime = now;
+	_spanStartStats = *stats;
+	_spanTicks = 0;
+	_spanEvents = 0;
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,120 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_INPUT_H
+#define STARTREK_INPUT_H
+
+#include "common/array.h"
+#include "common/events.h"
+#include "common/file.h"
+#include "common/str.h"
+
+#include "startrek/stats.h"
+
+namespace StarTrek {
+
+class StarTrekEngine;
+
+enum InputMode {
+	kInputLive,
+	kInputRecord,
+	kInputReplay
+};
+
+/**
+ * Records the events the main loop receives, with the tick they arrived
+ * on, and plays them back so a session can be repeated exactly.
+ *
+ * A recording is tab separated, one line per event and a last line with
+ * the number of ticks:
+ *   event  <tick>  <milliseconds>  <type>  <keycode>  <ascii>  <flags>  <x>  <y>
+ *   end    <ticks>
+ *
+ * A replay runs the ticks back to back on a virtual clock which advances
+ * TICK_MILLIS per tick. Game timing, such as movie frames, sound effect
+ * ages and autosaves, uses that clock through StarTrekEngine::getMillis().
+ * The audio latency figures stay on the system clock, as they measure it.
+ *
+ * The cost is written as CSV, one row per REPORT_SPAN_TICKS ticks. A
+ * single tick mostly takes less than the millisecond the system clock
+ * counts, so wall_ms covers the whole span and us_per_tick is its average;
+ * elapsed_ms is the running total since the replay started. Pair it with
+ * the null graphics and audio backends to measure only the engine.
+ */
+class InputRecorder {
+public:
+	InputRecorder(StarTrekEngine *vm);
+	~InputRecorder();
+
+	bool startRecording(const Common::String &filename);
+	bool startReplay(const Common::String &filename, const Common::String &reportFilename);
+	void stop();
+
+	InputMode getMode() const { return _mode; }
+	bool isReplayFinished() const { return _mode == kInputReplay && _tick >= _tickCount; }
+
+	// Takes the place of the event manager's pollEvent() in the main loop
+	bool pollEvent(Common::Event &event);
+	void endTick();
+
+	uint32 getTick() const { return _tick; }
+	uint32 getTime() const; // in milliseconds, virtual during a replay
+
+	static const uint32 TICK_MILLIS = 10;
+	static const uint32 REPORT_SPAN_TICKS = 100;
+
+private:
+	struct RecordedEvent {
+		uint32 tick;
+		uint32 time;
+		Common::Event event;
+	};
+
+	StarTrekEngine *_vm;
+	InputMode _mode;
+
+	uint32 _tick;
+	uint32 _startTime;
+
+	Common::DumpFile _recording;
+
+	Common::Array<RecordedEvent> _events;
+	uint32 _nextEvent;
+	uint32 _tickCount;
+
+	Common::DumpFile _report;
+	uint32 _spanStartTime;
+	EngineStats _spanStartStats;
+	uint32 _spanTicks;
+	uint32 _spanEvents;
+	uint32 _totalTime;
+
+	void writeReportSpan();
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -0,0 +1,128 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/latency.h"
+
+#include "common/file.h"
+#include "common/system.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+AudioLatency::AudioLatency() {
+	reset();
+}
+
+void AudioLatency::record(LatencyCategory category, uint32 time) {
+	Common::StackLock lock(_mutex);
+	LatencyHistogram &histogram = _histograms[category];
+
+	byte bucket = 0;
+	while (bucket < NUM_LATENCY_BUCKETS - 1 && time >= getBucketStart(bucket + 1))
+		bucket++;
+
+	histogram.buckets[bucket]++;
+	histogram.min = histogram.count ? MIN(histogram.min, time) : time;
+	histogram.max = MAX(histogram.max, time);
+	histogram.total += time;
+	histogram.count++;
+}
+
+void AudioLatency::recordUnderrun() {
+	Common::StackLock lock(_mutex);
+	_underruns++;
+}
+
+void AudioLatency::reset() {
+	Common::StackLock lock(_mutex);
+	memset(_histograms, 0, sizeof(_histograms));
+	_underruns = 0;
+}
+
+LatencyHistogram AudioLatency::getHistogram(LatencyCategory category) {
+	Common::StackLock lock(_mutex);
+	return _histograms[category];
+}
+
+uint32 AudioLatency::getUnderruns() {
+	Common::StackLock lock(_mutex);
+	return _underruns;
+}
+
+bool AudioLatency::exportToFile(const Common::String &filename) {
+	Common::DumpFile file;
+	if (!file.open(filename))
+		return false;
+
+	// One line per bucket: category, bucket start and end in microseconds, count
+	file.writeString("category,start_us,end_us,count\n");
+
+	for (byte i = 0; i < kLatencyCategoryCount; i++) {
+		LatencyHistogram histogram = getHistogram((LatencyCategory)i);
+
+		for (byte j = 0; j < NUM_LATENCY_BUCKETS; j++) {
+			Common::String end = (j < NUM_LATENCY_BUCKETS - 1) ? Common::String::printf("%d", getBucketStart(j + 1)) : "";
+			file.writeString(Common::String::printf("%s,%d,%s,%d\n", getCategoryName((LatencyCategory)i), getBucketStart(j), end.c_str(), histogram.buckets[j]));
+		}
+	}
+
+	file.writeString(Common::String::printf("underruns,,,%d\n", getUnderruns()));
+	file.flush();
+	return !file.err();
+}
+
+const char *AudioLatency::getCategoryName(LatencyCategory category) {
+	static const char *names[] = { "request", "first-mix", "midi-jitter" };
+	return names[category];
+}
+
+uint32 AudioLatency::getBucketStart(byte bucket) {
+	return bucket ? (1000 << (bucket - 1)) : 0;
+}
+
+LatencyProbeStream::LatencyProbeStream(Audio::AudioStream *parent, AudioLatency *latency) : _parent(parent), _latency(latency) {
+	_readyTime = g_system->getMillis();
+	_mixed = false;
+}
+
+LatencyProbeStream::~LatencyProbeStream() {
+	delete _parent;
+}
+
+int LatencyProbeStream::readBuffer(int16 *buffer, const int numSamples) {
+	if (!_mixed) {
+		_latency->record(kLatencyFirstMix, (g_system->getMillis() - _readyTime) * 1000);
+		_mixed = true;
+	}
+
+	int samples = _parent->readBuffer(buffer, numSamples);
+	if (samples < numSamples && !_parent->endOfStream())
+		_latency->recordUnderrun();
+
+	return samples;
+}
+
+} // End of namespace StarTrek
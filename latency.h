@@ -0,0 +1,106 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_LATENCY_H
+#define STARTREK_LATENCY_H
+
+#include "common/mutex.h"
+#include "common/str.h"
+
+#include "sound/audiostream.h"
+
+namespace StarTrek {
+
+enum LatencyCategory {
+	kLatencyRequest = 0, // Sound request until its stream is handed to the mixer
+	kLatencyFirstMix,    // Stream handed over until its first mixed buffer
+	kLatencyMidiJitter,  // Deviation of the MIDI timer period from the nominal one
+	kLatencyCategoryCount
+};
+
+// Bucket 0 holds times below 1 ms, bucket n times from 2^(n-1) to 2^n ms
+static const byte NUM_LATENCY_BUCKETS = 12;
+
+struct LatencyHistogram {
+	uint32 buckets[NUM_LATENCY_BUCKETS];
+	uint32 count;
+	uint32 min, max; // in microseconds
+	double total;
+};
+
+/**
+ * Collects timing histograms for the audio path. Samples are recorded from
+ * the main thread, the mixer and the timer callback, so all access goes
+ * through a mutex. The clock is OSystem::getMillis(), so times below a
+ * millisecond cannot be told apart.
+ */
+class AudioLatency {
+public:
+	AudioLatency();
+
+	void record(LatencyCategory category, uint32 time);
+	void recordUnderrun();
+	void reset();
+
+	LatencyHistogram getHistogram(LatencyCategory category);
+	uint32 getUnderruns();
+	bool exportToFile(const Common::String &filename);
+
+	static const char *getCategoryName(LatencyCategory category);
+	static uint32 getBucketStart(byte bucket);
+
+private:
+	Common::Mutex _mutex;
+	LatencyHistogram _histograms[kLatencyCategoryCount];
+	uint32 _underruns;
+};
+
+/**
+ * Passes a stream through to the mixer, recording when it is first read
+ * and counting the reads that come up short although the stream has not
+ * ended, as a queue the decoder has not kept filled does.
+ */
+class LatencyProbeStream : public Audio::AudioStream {
+public:
+	LatencyProbeStream(Audio::AudioStream *parent, AudioLatency *latency);
+	~LatencyProbeStream();
+
+	int readBuffer(int16 *buffer, const int numSamples);
+	bool isStereo() const { return _parent->isStereo(); }
+	int getRate() const { return _parent->getRate(); }
+	bool endOfData() const { return _parent->endOfData(); }
+	bool endOfStream() const { return _parent->endOfStream(); }
+
+private:
+	Audio::AudioStream *_parent;
+	AudioLatency *_latency;
+	uint32 _readyTime;
+	bool _mixed;
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -23,19 +23,22 @@
  *
  */
 
+#include "startrek/arena.h"
 #include "startrek/lzss.h"
+#include "common/endian.h"
 #include "common/util.h"
 #include "common/memstream.h"
 
 namespace StarTrek {
 
-Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint32 uncompressedSize) {
+Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint32 uncompressedSize, Arena *arena, uint32 *decodedSize) {
 	uint32 N = 0x1000; /* History buffer size */
-	byte *histbuff = new byte[N]; /* History buffer */
+	ArenaScope scope(arena);
+	byte *histbuff = arena ? (byte *)arena->allocate(N) : new byte[N]; /* History buffer */
 	memset(histbuff, 0, N);
 	uint32 outstreampos = 0;
 	uint32 bufpos = 0;
-	byte *outLzssBufData = (byte *)malloc(uncompressedSize);
+	byte *outLzssBufData = (byte *)calloc(MAX<uint32>(uncompressedSize, 1), 1);
 
 	for (;;) {
 		byte flagbyte = indata->readByte();
@@ -54,7 +57,9 @@ Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint3
 				uint32 offset = (bufpos - (offsetlen >> 4)) & (N - 1);
 				for (uint32 j = 0; j < length; j++) {
 					byte tempa = histbuff[(offset + j) & (N - 1)];
-					outLzssBufData[outstreampos++] = tempa;
+					if (outstreampos < uncompressedSize)
+						outLzssBufData[outstreampos] = tempa;
+					outstreampos++;
 					histbuff[bufpos] = tempa;
 					bufpos = (bufpos + 1) & (N - 1);
 				}
@@ -64,16 +69,187 @@ Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint3
 				if (indata->eos())
 					break;
 
-				outLzssBufData[outstreampos++] = tempa;
+				if (outstreampos < uncompressedSize)
+					outLzssBufData[outstreampos] = tempa;
+				outstreampos++;
 				histbuff[bufpos] = tempa;
 				bufpos = (bufpos + 1) & (N - 1);
 			}
 		}
 	}
 
-	delete[] histbuff;	
+	if (!arena)
+		delete[] histbuff;
+
+	// Corrupt data decodes to a different size; what does not fit is dropped
+	if (decodedSize)
+		*decodedSize = outstreampos;
+
 	return new Common::MemoryReadStream(outLzssBufData, uncompressedSize, DisposeAfterUse::YES);
 }
 
+LZSSReadStream::LZSSReadStream(Common::SeekableReadStream *indata, uint32 uncompressedSize, DisposeAfterUse::Flag disposeParent)
+	: _indata(indata), _disposeParent(disposeParent), _size(uncompressedSize) {
+	reset();
+}
+
+LZSSReadStream::~LZSSReadStream() {
+	if (_disposeParent == DisposeAfterUse::YES)
+		delete _indata;
+}
+
+void LZSSReadStream::reset() {
+	_indata->seek(0);
+	memset(_history, 0, kHistorySize);
+	_pos = 0;
+	_eos = false;
+	_bufPos = 0;
+	_flagBit = 8;
+	_matchLeft = 0;
+	_inputEnd = false;
+}
+
+byte LZSSReadStream::decodeByte() {
+	byte value;
+
+	if (_matchLeft) {
+		value = _history[_matchOffset];
+		_matchOffset = (_matchOffset + 1) & (kHistorySize - 1);
+		_matchLeft--;
+	} else {
+		if (_inputEnd)
+			return 0;
+
+		if (_flagBit == 8) {
+			_flags = _indata->readByte();
+			_flagBit = 0;
+		}
+
+		if (!_indata->eos() && (_flags & (1 << _flagBit++))) {
+			value = _indata->readByte();
+		} else {
+			uint32 offsetlen = _indata->readUint16LE();
+			_matchLeft = (offsetlen & 0xF) + 3;
+			_matchOffset = (_bufPos - (offsetlen >> 4)) & (kHistorySize - 1);
+		}
+
+		// As in decodeLZSS(), a short read ends the data
+		if (_indata->eos()) {
+			_inputEnd = true;
+			_matchLeft = 0;
+			return 0;
+		}
+
+		if (_matchLeft)
+			return decodeByte();
+	}
+
+	_history[_bufPos] = value;
+	_bufPos = (_bufPos + 1) & (kHistorySize - 1);
+	return value;
+}
+
+uint32 LZSSReadStream::read(void *dataPtr, uint32 dataSize) {
+	if (dataSize > _size - _pos) {
+		dataSize = _size - _pos;
+		_eos = true;
+	}
+
+	byte *out = (byte *)dataPtr;
+	for (uint32 i = 0; i < dataSize; i++)
+		out[i] = decodeByte();
+
+	_pos += dataSize;
+	return dataSize;
+}
+
+bool LZSSReadStream::seek(int32 offset, int whence) {
+	int32 target = offset;
+	if (whence == SEEK_CUR)
+		target += _pos;
+	else if (whence == SEEK_END)
+		target += _size;
+
+	if (target < 0 || target > (int32)_size)
+		return false;
+
+	if ((uint32)target < _pos)
+		reset();
+
+	while (_pos < (uint32)target) {
+		decodeByte();
+		_pos++;
+	}
+
+	_eos = false;
+	return true;
+}
+
+byte *encodeLZSS(const byte *data, uint32 size, uint32 &compressedSize) {
+	const uint32 N = 0x1000;
+	const uint32 maxLength = 0xF + 3;
+	const uint32 hashSize = 0x1000;
+
+	// A greedy matcher that only checks the last position with the same
+	// hash. Good enough for generated data, not for a real encoder.
+	int32 *hashHead = new int32[hashSize];
+	for (uint32 i = 0; i < hashSize; i++)
+		hashHead[i] = -1;
+
+	// Every 8 items add a flag byte, literals are one byte each
+	byte *out = (byte *)malloc(size + size / 8 + 2);
+	uint32 outPos = 0;
+	uint32 flagPos = 0;
+	byte bit = 0;
+
+#define HASH(p) (((data[p] << 8) ^ (data[(p) + 1] << 4) ^ data[(p) + 2]) & (hashSize - 1))
+
+	uint32 pos = 0;
+	while (pos < size) {
+		if (bit == 0) {
+			flagPos = outPos++;
+			out[flagPos] = 0;
+		}
+
+		uint32 length = 0;
+		uint32 distance = 0;
+
+		if (pos + 3 <= size) {
+			uint32 hash = HASH(pos);
+			int32 candidate = hashHead[hash];
+			hashHead[hash] = pos;
+
+			if (candidate >= 0 && pos - candidate < N) {
+				uint32 limit = MIN(maxLength, size - pos);
+				while (length < limit && data[candidate + length] == data[pos + length])
+					length++;
+				distance = pos - candidate;
+			}
+		}
+
+		if (length >= 3) {
+			WRITE_LE_UINT16(out + outPos, (distance << 4) | (length - 3));
+			outPos += 2;
+
+			for (uint32 i = 1; i < length; i++)
+				if (pos + i + 3 <= size)
+					hashHead[HASH(pos + i)] = pos + i;
+
+			pos += length;
+		} else {
+			out[flagPos] |= 1 << bit;
+			out[outPos++] = data[pos++];
+		}
+
+		bit = (bit + 1) & 7;
+	}
+
+#undef HASH
+
+	delete[] hashHead;
+	compressedSize = outPos;
+	return out;
+}
+
 }
 
@@ -27,31 +27,51 @@
 
 namespace StarTrek {
 
-Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint32 uncompressedSize);
+class Arena;
 
-/*
-class LzssReadStream : public Common::SeekableReadStream {
-private:
-	uint8 *_outLzssBufData;
-	uint32 _size;
-	uint32 _pos;
+// The history buffer comes from the arena if one is given. The number of
+// bytes the data actually decoded to is returned in decodedSize.
+Common::SeekableReadStream *decodeLZSS(Common::SeekableReadStream *indata, uint32 uncompressedSize, Arena *arena = 0, uint32 *decodedSize = 0);
 
-	uint32 decodeLZSS(Common::ReadStream *in, uint8 lengthmask, uint8 lengthbits);
+// Compresses data in the format decodeLZSS() reads. The result is
+// allocated with malloc().
+byte *encodeLZSS(const byte *data, uint32 size, uint32 &compressedSize);
 
+/**
+ * Decodes an LZSS member as it is read, so only the history buffer is held
+ * in memory. Seeking forward decodes up to the new position, seeking back
+ * starts over from the beginning of the data.
+ */
+class LZSSReadStream : public Common::SeekableReadStream {
 public:
-	LzssReadStream(Common::ReadStream *indata, uint8 lengthmask, uint8 lengthbits);
-	~LzssReadStream();
+	LZSSReadStream(Common::SeekableReadStream *indata, uint32 uncompressedSize, DisposeAfterUse::Flag disposeParent);
+	~LZSSReadStream();
 
-	bool eos() const;
-	uint32 read(void *buf, uint32 length);
+	bool eos() const { return _eos; }
+	uint32 read(void *dataPtr, uint32 dataSize);
 	int32 pos() const { return _pos; }
 	int32 size() const { return _size; }
-	bool seek(int32 offset, int whence) {
-		// TODO
-		return false;
-	}
+	bool seek(int32 offset, int whence = SEEK_SET);
+
+private:
+	static const uint32 kHistorySize = 0x1000;
+
+	Common::SeekableReadStream *_indata;
+	DisposeAfterUse::Flag _disposeParent;
+	uint32 _size;
+	uint32 _pos;
+	bool _eos;
+
+	byte _history[kHistorySize];
+	uint32 _bufPos;
+	byte _flags;
+	byte _flagBit;
+	uint32 _matchOffset;
+	uint32 _matchLeft;
+	bool _inputEnd;
 
+	void reset();
+	byte decodeByte(); // 0 once the data has run out
 };
-*/
 
 }
@@ -0,0 +1,60 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/macres.h"
+
+namespace StarTrek {
+
+MacResourceIndex::MacResourceIndex(Common::MacResManager *resFork) : _resFork(resFork) {
+	Common::MacResTagArray types = _resFork->getResTagArray();
+
+	for (uint32 i = 0; i < types.size(); i++) {
+		Common::MacResIDArray ids = _resFork->getResIDArray(types[i]);
+
+		for (uint32 j = 0; j < ids.size(); j++) {
+			Common::String name = _resFork->getResName(types[i], ids[j]);
+
+			// The first one found wins, as with getResource()
+			if (name.empty() || _resources.contains(name))
+				continue;
+
+			ResourceRef ref;
+			ref.typeID = types[i];
+			ref.resID = ids[j];
+			_resources[name] = ref;
+		}
+	}
+}
+
+Common::SeekableReadStream *MacResourceIndex::getResource(const Common::String &name) {
+	ResourceMap::const_iterator it = _resources.find(name);
+	if (it == _resources.end())
+		return 0;
+
+	return _resFork->getResource(it->_value.typeID, it->_value.resID);
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,66 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_MACRES_H
+#define STARTREK_MACRES_H
+
+#include "common/hash-str.h"
+#include "common/hashmap.h"
+#include "common/macresman.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+namespace StarTrek {
+
+/**
+ * Name lookup for a Macintosh resource fork. MacResManager::getResource()
+ * searches every resource's name on each call; here the map is walked once
+ * and names resolve to their type and ID with a hash lookup.
+ */
+class MacResourceIndex {
+public:
+	MacResourceIndex(Common::MacResManager *resFork);
+
+	bool hasResource(const Common::String &name) const { return _resources.contains(name); }
+	Common::SeekableReadStream *getResource(const Common::String &name); // 0 if missing
+	uint32 getResourceCount() const { return _resources.size(); }
+
+private:
+	struct ResourceRef {
+		uint32 typeID;
+		uint16 resID;
+	};
+
+	// Resource Manager names are not case sensitive
+	typedef Common::HashMap<Common::String, ResourceRef, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> ResourceMap;
+
+	Common::MacResManager *_resFork;
+	ResourceMap _resources;
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -0,0 +1,179 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/membercache.h"
+
+#include "common/endian.h"
+#include "common/md5.h"
+#include "common/system.h"
+#include "common/util.h"
+
+#ifdef POSIX
+#include <stdio.h>
+#endif
+
+namespace StarTrek {
+
+static const uint32 MEMBER_CACHE_MAGIC = MKID_BE('STMC');
+static const uint32 MEMBER_CACHE_TRAILER_SIZE = 8;
+
+// As many bytes as detection hashes
+static const uint32 GAME_KEY_MD5_BYTES = 5000;
+
+MemberCache::MemberCache(const Common::FSNode &directory, const Common::String &gameKey) : _directory(directory), _gameKey(gameKey) {
+	_hits = 0;
+	_misses = 0;
+	_stored = 0;
+}
+
+Common::String MemberCache::computeGameKey(Common::SeekableReadStream *dataFile) {
+	char md5str[32 + 1];
+	int32 pos = dataFile->pos();
+
+	dataFile->seek(0);
+	bool hashed = Common::md5_file_string(*dataFile, md5str, GAME_KEY_MD5_BYTES);
+	dataFile->seek(pos);
+
+	if (!hashed)
+		return Common::String();
+
+	// Releases with the same start but a different length get their own key
+	return Common::String::printf("%s-%d", md5str, dataFile->size());
+}
+
+Common::FSNode MemberCache::getCacheNode(const Common::String &filename) const {
+	Common::String name = _gameKey + "-" + filename;
+	name.toLowercase();
+	return _directory.getChild(name);
+}
+
+// The size of the member in a complete cache file, -1 for anything else
+static int32 getCachedSize(Common::SeekableReadStream *file) {
+	int32 fileSize = file->size();
+	if (fileSize < (int32)MEMBER_CACHE_TRAILER_SIZE)
+		return -1;
+
+	int32 size = fileSize - MEMBER_CACHE_TRAILER_SIZE;
+	file->seek(size);
+	uint32 magic = file->readUint32BE();
+	uint32 storedSize = file->readUint32LE();
+
+	if (file->err() || magic != MEMBER_CACHE_MAGIC || storedSize != (uint32)size)
+		return -1;
+
+	// The trailer must have been the end of the file when it was read
+	if (file->size() != fileSize)
+		return -1;
+
+	file->seek(0);
+	return size;
+}
+
+Common::SeekableReadStream *MemberCache::openMember(const Common::String &filename) {
+	Common::FSNode node = getCacheNode(filename);
+	Common::SeekableReadStream *file = node.exists() ? node.createReadStream() : 0;
+	int32 size = file ? getCachedSize(file) : -1;
+
+	if (size < 0) {
+		delete file;
+		_misses++;
+		return 0;
+	}
+
+	_hits++;
+	return new Common::SeekableSubReadStream(file, 0, size, DisposeAfterUse::YES);
+}
+
+bool MemberCache::hasValidFile(const Common::FSNode &node) const {
+	Common::SeekableReadStream *file = node.exists() ? node.createReadStream() : 0;
+	bool valid = file && getCachedSize(file) >= 0;
+	delete file;
+	return valid;
+}
+
+void MemberCache::storeMember(const Common::String &filename, Common::SeekableReadStream *stream) {
+	Common::FSNode node = getCacheNode(filename);
+
+	// Another instance may have stored it since the miss
+	if (hasValidFile(node))
+		return;
+
+#ifdef POSIX
+	// Written under a name of its own and renamed into place when complete,
+	// so files others may be reading are never rewritten
+	Common::String tempName = Common::String::printf("%s.%08x%08x.tmp", node.getName().c_str(), g_system->getMillis(), (uint32)(size_t)this ^ _stored);
+	Common::FSNode tempNode = _directory.getChild(tempName);
+#else
+	// The FSNode API cannot rename files. The member is written in place,
+	// where the trailer keeps others from using it before it is complete.
+	Common::FSNode tempNode = node;
+#endif
+
+	Common::WriteStream *file = tempNode.createWriteStream();
+	if (!file) {
+		warning("Could not write '%s' to the member cache", filename.c_str());
+		return;
+	}
+
+	byte buffer[4096];
+	uint32 size = 0;
+
+	stream->seek(0);
+	while (!stream->eos() && !stream->err()) {
+		uint32 length = stream->read(buffer, sizeof(buffer));
+		if (!length)
+			break;
+		file->write(buffer, length);
+		size += length;
+	}
+	stream->seek(0);
+
+	file->writeUint32BE(MEMBER_CACHE_MAGIC);
+	file->writeUint32LE(size);
+	file->finalize();
+	bool written = !file->err();
+	delete file;
+
+#ifdef POSIX
+	// rename() replaces the target atomically; when it fails, another
+	// instance may have stored the member first
+	if (!written || rename(tempNode.getPath().c_str(), node.getPath().c_str()) != 0) {
+		remove(tempNode.getPath().c_str());
+		if (!written)
+			warning("Could not write '%s' to the member cache", filename.c_str());
+		return;
+	}
+#else
+	if (!written) {
+		warning("Could not write '%s' to the member cache", filename.c_str());
+		return;
+	}
+#endif
+
+	_stored++;
+}
+
+} // End of namespace StarTrek
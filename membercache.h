@@ -0,0 +1,79 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_MEMBERCACHE_H
+#define STARTREK_MEMBERCACHE_H
+
+#include "common/fs.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+namespace StarTrek {
+
+/**
+ * Decompressed archive members kept on disk, so engines running against
+ * the same game files decompress each member only once between them. The
+ * cache files are named after the MD5 of the data file and the member.
+ *
+ * A hit is read straight from the cache file, which the OS keeps in its
+ * page cache for all the processes. On POSIX builds a member is written to
+ * a temporary file that is renamed into place once complete, so a cache
+ * file is never rewritten while others read it; elsewhere it is written in
+ * place. Files end with a trailer that is checked when they are opened.
+ */
+class MemberCache {
+public:
+	MemberCache(const Common::FSNode &directory, const Common::String &gameKey);
+
+	// 0 on a miss
+	Common::SeekableReadStream *openMember(const Common::String &filename);
+
+	// Copies a decoded member into the cache unless it is there already,
+	// leaving the stream at its start
+	void storeMember(const Common::String &filename, Common::SeekableReadStream *stream);
+
+	uint32 getHits() const { return _hits; }
+	uint32 getMisses() const { return _misses; }
+	uint32 getStored() const { return _stored; }
+
+	// The key for a data file, read from its start as for detection
+	static Common::String computeGameKey(Common::SeekableReadStream *dataFile);
+
+private:
+	Common::FSNode _directory;
+	Common::String _gameKey;
+
+	uint32 _hits;
+	uint32 _misses;
+	uint32 _stored;
+
+	Common::FSNode getCacheNode(const Common::String &filename) const;
+	bool hasValidFile(const Common::FSNode &node) const;
+};
+
+} // End of namespace StarTrek
+
+#endif
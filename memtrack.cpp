@@ -0,0 +1,133 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/memtrack.h"
+
+#include "common/util.h"
+
+namespace StarTrek {
+
+MemoryTracker::MemoryTracker() {
+	for (byte i = 0; i < kMemSubsystemCount; i++) {
+		_liveBytes[i] = 0;
+		_peakBytes[i] = 0;
+		_allocationCount[i] = 0;
+	}
+
+	_scene = 0;
+}
+
+MemoryTracker::~MemoryTracker() {
+}
+
+void *MemoryTracker::allocate(MemorySubsystem subsystem, const Common::String &resource, uint32 size, bool persistent) {
+	void *data = malloc(MAX<uint32>(size, 1));
+	track(data, subsystem, resource, size, persistent);
+	return data;
+}
+
+void MemoryTracker::release(void *data) {
+	untrack(data);
+	free(data);
+}
+
+void MemoryTracker::track(const void *data, MemorySubsystem subsystem, const Common::String &resource, uint32 size, bool persistent) {
+	if (!data)
+		return;
+
+	// Memory can be handed back and forth, count it once
+	untrack(data);
+
+	Allocation allocation;
+	allocation.subsystem = subsystem;
+	allocation.resource = resource;
+	allocation.size = size;
+	allocation.scene = _scene;
+	allocation.persistent = persistent;
+	_allocations[data] = allocation;
+
+	_liveBytes[subsystem] += size;
+	_peakBytes[subsystem] = MAX(_peakBytes[subsystem], _liveBytes[subsystem]);
+	_allocationCount[subsystem]++;
+}
+
+void MemoryTracker::retain(const void *data) {
+	AllocationMap::iterator it = _allocations.find(data);
+	if (it != _allocations.end())
+		it->_value.scene = _scene;
+}
+
+void MemoryTracker::untrack(const void *data) {
+	if (!data)
+		return;
+
+	AllocationMap::iterator it = _allocations.find(data);
+	if (it == _allocations.end())
+		return;
+
+	_liveBytes[it->_value.subsystem] -= it->_value.size;
+	_allocations.erase(it);
+}
+
+void MemoryTracker::listAllocations(Common::Array<Common::String> &lines, bool outlivedOnly) const {
+	for (AllocationMap::const_iterator it = _allocations.begin(); it != _allocations.end(); ++it) {
+		const Allocation &allocation = it->_value;
+
+		if (outlivedOnly && (allocation.persistent || allocation.scene == _scene))
+			continue;
+
+		lines.push_back(Common::String::printf("%-8s %-16s %8d bytes, scene %d%s", getSubsystemName(allocation.subsystem),
+				allocation.resource.c_str(), allocation.size, allocation.scene, allocation.persistent ? " (persistent)" : ""));
+	}
+}
+
+void MemoryTracker::reportLeaks() const {
+	Common::Array<Common::String> lines;
+	listAllocations(lines, false);
+
+	for (uint32 i = 0; i < lines.size(); i++)
+		warning("Leaked: %s", lines[i].c_str());
+
+	for (byte i = 0; i < kMemSubsystemCount; i++)
+		debug(1, "Memory: %s peaked at %d bytes over %d allocations", getSubsystemName((MemorySubsystem)i), _peakBytes[i], _allocationCount[i]);
+}
+
+const char *MemoryTracker::getSubsystemName(MemorySubsystem subsystem) {
+	static const char *names[] = { "archive", "graphics", "font", "sound", "movie" };
+	return names[subsystem];
+}
+
+TrackedReadStream::TrackedReadStream(Common::SeekableReadStream *parent, MemoryTracker *tracker, MemorySubsystem subsystem, const Common::String &resource)
+		: _parent(parent), _tracker(tracker) {
+	_tracker->track(this, subsystem, resource, _parent->size());
+}
+
+TrackedReadStream::~TrackedReadStream() {
+	_tracker->untrack(this);
+	delete _parent;
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,125 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_MEMTRACK_H
+#define STARTREK_MEMTRACK_H
+
+#include "common/array.h"
+#include "common/hashmap.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+namespace StarTrek {
+
+enum MemorySubsystem {
+	kMemArchive = 0,
+	kMemGraphics,
+	kMemFont,
+	kMemSound,
+	kMemMovie,
+	kMemSubsystemCount
+};
+
+/**
+ * Keeps account of the memory resources hold on to, by subsystem and by
+ * resource name. Allocations are made either through allocate()/release()
+ * or registered with track()/untrack() by their owners.
+ *
+ * Persistent allocations, such as cache entries, are expected to outlive
+ * the scene they were made in; for all others that is reported as a leak.
+ */
+class MemoryTracker {
+public:
+	MemoryTracker();
+	~MemoryTracker();
+
+	void *allocate(MemorySubsystem subsystem, const Common::String &resource, uint32 size, bool persistent = false);
+	void release(void *data);
+
+	void track(const void *data, MemorySubsystem subsystem, const Common::String &resource, uint32 size, bool persistent = false);
+	void untrack(const void *data);
+	// Moves an allocation into the current scene, for entries kept on purpose
+	void retain(const void *data);
+
+	void nextScene() { _scene++; }
+
+	uint32 getLiveBytes(MemorySubsystem subsystem) const { return _liveBytes[subsystem]; }
+	uint32 getPeakBytes(MemorySubsystem subsystem) const { return _peakBytes[subsystem]; }
+	uint32 getAllocationCount(MemorySubsystem subsystem) const { return _allocationCount[subsystem]; }
+
+	// One line per live allocation, optionally only those from past scenes
+	void listAllocations(Common::Array<Common::String> &lines, bool outlivedOnly) const;
+	void reportLeaks() const;
+
+	static const char *getSubsystemName(MemorySubsystem subsystem);
+
+private:
+	struct Allocation {
+		MemorySubsystem subsystem;
+		Common::String resource;
+		uint32 size;
+		uint32 scene;
+		bool persistent;
+	};
+
+	struct PointerHash {
+		uint operator()(const void *data) const { return (uint)((size_t)data >> 3); }
+	};
+
+	typedef Common::HashMap<const void *, Allocation, PointerHash> AllocationMap;
+	AllocationMap _allocations;
+
+	uint32 _liveBytes[kMemSubsystemCount];
+	uint32 _peakBytes[kMemSubsystemCount];
+	uint32 _allocationCount[kMemSubsystemCount];
+	uint32 _scene;
+};
+
+/**
+ * Wraps a resource stream held in memory so the tracker sees it until
+ * the stream is deleted.
+ */
+class TrackedReadStream : public Common::SeekableReadStream {
+public:
+	TrackedReadStream(Common::SeekableReadStream *parent, MemoryTracker *tracker, MemorySubsystem subsystem, const Common::String &resource);
+	~TrackedReadStream();
+
+	bool eos() const { return _parent->eos(); }
+	bool err() const { return _parent->err(); }
+	void clearErr() { _parent->clearErr(); }
+	uint32 read(void *dataPtr, uint32 dataSize) { return _parent->read(dataPtr, dataSize); }
+	int32 pos() const { return _parent->pos(); }
+	int32 size() const { return _parent->size(); }
+	bool seek(int32 offset, int whence = SEEK_SET) { return _parent->seek(offset, whence); }
+
+private:
+	Common::SeekableReadStream *_parent;
+	MemoryTracker *_tracker;
+};
+
+} // End of namespace StarTrek
+
+#endif
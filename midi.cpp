@@ -0,0 +1,523 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "startrek/midi.h"
+
+#include "common/algorithm.h"
+#include "common/endian.h"
+#include "common/system.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+// XMIDI runs at a fixed 120 ticks per second
+static const uint32 XMIDI_TICK_RATE = 120;
+
+// XMIDI loop controllers
+static const byte XMIDI_CONTROLLER_FOR_LOOP = 0x74;
+static const byte XMIDI_CONTROLLER_NEXT_BREAK = 0x75;
+
+enum PendingEventType {
+	kPendingMessage,
+	kPendingSysEx,
+	kPendingTempo,
+	kPendingLoopStart,
+	kPendingLoopEnd
+};
+
+// Events are gathered with their tick and stream order before being sorted
+struct PendingEvent {
+	uint32 tick;
+	uint32 order;
+	byte type;
+	bool noteOff;
+	uint32 data;
+};
+
+struct PendingEventLess {
+	bool operator()(const PendingEvent &a, const PendingEvent &b) const {
+		if (a.tick != b.tick)
+			return a.tick < b.tick;
+		if (a.order != b.order)
+			return a.order < b.order;
+		// A note off sorts after the note on it belongs to
+		return !a.noteOff && b.noteOff;
+	}
+};
+
+typedef Common::Array<PendingEvent> PendingEventList;
+
+static uint32 readVLQ(const byte *&pos, const byte *end) {
+	uint32 value = 0;
+
+	while (pos < end) {
+		byte b = *pos++;
+		value = (value << 7) | (b & 0x7F);
+		if (!(b & 0x80))
+			break;
+	}
+
+	return value;
+}
+
+static void addPendingEvent(PendingEventList &list, uint32 tick, uint32 order, byte type, uint32 data, bool noteOff = false) {
+	PendingEvent event;
+	event.tick = tick;
+	event.order = order;
+	event.type = type;
+	event.noteOff = noteOff;
+	event.data = data;
+	list.push_back(event);
+}
+
+static uint32 addSysEx(MidiTimeline &timeline, const byte *data, uint32 length) {
+	// MidiDriver::sysEx() does not want the terminating 0xF7
+	if (length && data[length - 1] == 0xF7)
+		length--;
+
+	uint32 offset = timeline.sysExData.size();
+	timeline.sysExData.push_back(length & 0xFF);
+	timeline.sysExData.push_back(length >> 8);
+	for (uint32 i = 0; i < length; i++)
+		timeline.sysExData.push_back(data[i]);
+
+	return offset;
+}
+
+// Reads the channel message for the given status byte, returns false for
+// anything that is not a channel message
+static bool readChannelMessage(byte status, const byte *&pos, const byte *end, uint32 &message) {
+	byte param1 = 0, param2 = 0;
+
+	switch (status >> 4) {
+	case 0x8:
+	case 0x9:
+	case 0xA:
+	case 0xB:
+	case 0xE:
+		if (end - pos < 2)
+			return false;
+		param1 = *pos++;
+		param2 = *pos++;
+		break;
+	case 0xC:
+	case 0xD:
+		if (pos >= end)
+			return false;
+		param1 = *pos++;
+		break;
+	default:
+		return false;
+	}
+
+	message = status | (param1 << 8) | (param2 << 16);
+	return true;
+}
+
+// Sorts the pending events and converts them into the final timeline. XMIDI
+// uses a fixed tick rate, SMF ticks are converted with the tempo events.
+static void buildTimeline(PendingEventList &pending, uint16 division, bool fixedRate, MidiTimeline &timeline) {
+	Common::sort(pending.begin(), pending.end(), PendingEventLess());
+
+	timeline.events.clear();
+	timeline.events.reserve(pending.size());
+	timeline.loopStart = timeline.loopEnd = 0;
+	timeline.loopStartTime = timeline.loopEndTime = 0;
+	timeline.loopCount = 0;
+
+	// Find the first loop so notes held past its end can be cut there
+	bool hasLoopStart = false, hasLoop = false;
+	uint32 loopEndTick = 0, loopEndOrder = 0;
+	for (uint32 i = 0; i < pending.size() && !hasLoop; i++) {
+		if (pending[i].type == kPendingLoopStart)
+			hasLoopStart = true;
+		else if (pending[i].type == kPendingLoopEnd && hasLoopStart) {
+			hasLoop = true;
+			loopEndTick = pending[i].tick;
+			loopEndOrder = pending[i].order;
+		}
+	}
+
+	if (hasLoop) {
+		bool moved = false;
+		for (uint32 i = 0; i < pending.size(); i++) {
+			if (pending[i].noteOff && pending[i].order < loopEndOrder && pending[i].tick > loopEndTick) {
+				pending[i].tick = loopEndTick;
+				moved = true;
+			}
+		}
+		if (moved)
+			Common::sort(pending.begin(), pending.end(), PendingEventLess());
+	}
+
+	double tempo = 500000.0; // Microseconds per quarter note
+	double baseMicros = 0.0;
+	uint32 baseTick = 0;
+	bool inLoop = false, loopDone = false;
+
+	for (uint32 i = 0; i < pending.size(); i++) {
+		const PendingEvent &event = pending[i];
+		uint32 time;
+
+		if (fixedRate)
+			time = event.tick * (1000000 / XMIDI_TICK_RATE) + event.tick * (1000000 % XMIDI_TICK_RATE) / XMIDI_TICK_RATE;
+		else
+			time = (uint32)(baseMicros + (event.tick - baseTick) * tempo / division);
+
+		switch (event.type) {
+		case kPendingTempo:
+			baseMicros = baseMicros + (event.tick - baseTick) * tempo / division;
+			baseTick = event.tick;
+			tempo = event.data;
+			break;
+		case kPendingLoopStart:
+			if (!inLoop && !loopDone) {
+				inLoop = true;
+				timeline.loopStart = timeline.events.size();
+				timeline.loopStartTime = time;
+				timeline.loopCount = event.data;
+			}
+			break;
+		case kPendingLoopEnd:
+			if (inLoop) {
+				inLoop = false;
+				loopDone = true;
+				timeline.loopEnd = timeline.events.size();
+				timeline.loopEndTime = time;
+			}
+			break;
+		default: {
+			MidiTimeline::Event out;
+			out.time = time;
+			out.data = event.data;
+			timeline.events.push_back(out);
+			break;
+		}
+		}
+	}
+
+	// A loop without any events in it would never advance
+	if (!loopDone || timeline.loopEnd <= timeline.loopStart || timeline.loopEndTime <= timeline.loopStartTime) {
+		timeline.loopStart = timeline.loopEnd = 0;
+		timeline.loopStartTime = timeline.loopEndTime = 0;
+	}
+}
+
+// XMIDI
+
+static const byte *findXMIDIEvents(const byte *data, uint32 size, uint32 &eventSize) {
+	const byte *pos = data;
+	const byte *end = data + size;
+
+	// Multiple sequences are wrapped in FORM XDIR followed by CAT XMID
+	if (size >= 12 && !memcmp(pos, "FORM", 4) && !memcmp(pos + 8, "XDIR", 4)) {
+		uint32 formSize = READ_BE_UINT32(pos + 4);
+		pos += 8 + formSize + (formSize & 1);
+		if (end - pos < 12 || memcmp(pos, "CAT ", 4) || memcmp(pos + 8, "XMID", 4))
+			return 0;
+		pos += 12;
+	}
+
+	// Only the first sequence is used
+	if (end - pos < 12 || memcmp(pos, "FORM", 4) || memcmp(pos + 8, "XMID", 4))
+		return 0;
+	pos += 12;
+
+	while (end - pos >= 8) {
+		uint32 chunkSize = READ_BE_UINT32(pos + 4);
+		if (!memcmp(pos, "EVNT", 4)) {
+			eventSize = MIN<uint32>(chunkSize, end - pos - 8);
+			return pos + 8;
+		}
+		pos += 8 + chunkSize + (chunkSize & 1);
+	}
+
+	return 0;
+}
+
+bool loadXMIDITimeline(const byte *data, uint32 size, MidiTimeline &timeline) {
+	uint32 eventSize = 0;
+	const byte *pos = findXMIDIEvents(data, size, eventSize);
+	if (!pos)
+		return false;
+
+	const byte *end = pos + eventSize;
+	PendingEventList pending;
+	timeline.sysExData.clear();
+
+	uint32 tick = 0;
+	uint32 order = 0;
+
+	while (pos < end) {
+		// Delays are stored as a run of bytes below 0x80 that are added up
+		while (pos < end && *pos < 0x80)
+			tick += *pos++;
+		if (pos >= end)
+			break;
+
+		byte status = *pos++;
+		uint32 message;
+
+		if (status == 0xFF) {
+			if (pos >= end)
+				break;
+			byte type = *pos++;
+			uint32 length = readVLQ(pos, end);
+			if (type == 0x2F)
+				break;
+			// XMIDI ignores tempo changes
+			pos += MIN<uint32>(length, end - pos);
+		} else if (status == 0xF0 || status == 0xF7) {
+			uint32 length = MIN<uint32>(readVLQ(pos, end), end - pos);
+			addPendingEvent(pending, tick, order++, kPendingSysEx, 0xF0 | (addSysEx(timeline, pos, length) << 8));
+			pos += length;
+		} else if (readChannelMessage(status, pos, end, message)) {
+			byte type = status >> 4;
+			byte param1 = (message >> 8) & 0xFF;
+			byte param2 = (message >> 16) & 0xFF;
+
+			if (type == 0xB && param1 == XMIDI_CONTROLLER_FOR_LOOP) {
+				addPendingEvent(pending, tick, order++, kPendingLoopStart, param2);
+			} else if (type == 0xB && param1 == XMIDI_CONTROLLER_NEXT_BREAK) {
+				if (param2 >= 64)
+					addPendingEvent(pending, tick, order++, kPendingLoopEnd, 0);
+			} else if (type == 0x9) {
+				// Note on is followed by its duration; turn that into a note off
+				uint32 duration = readVLQ(pos, end);
+				addPendingEvent(pending, tick, order, kPendingMessage, message);
+				addPendingEvent(pending, tick + duration, order, kPendingMessage, (status & 0x0F) | 0x80 | (param1 << 8), true);
+				order++;
+			} else {
+				addPendingEvent(pending, tick, order++, kPendingMessage, message);
+			}
+		} else {
+			warning("Invalid XMIDI event %02x", status);
+			break;
+		}
+	}
+
+	buildTimeline(pending, 0, true, timeline);
+	return true;
+}
+
+// Standard MIDI
+
+bool loadSMFTimeline(const byte *data, uint32 size, MidiTimeline &timeline) {
+	if (size < 14 || memcmp(data, "MThd", 4))
+		return false;
+
+	uint32 headerSize = READ_BE_UINT32(data + 4);
+	uint16 trackCount = READ_BE_UINT16(data + 10);
+	uint16 division = READ_BE_UINT16(data + 12);
+
+	if (!division || (division & 0x8000)) {
+		warning("SMPTE based MIDI timing is not supported");
+		return false;
+	}
+
+	const byte *pos = data + MIN<uint32>(8 + headerSize, size);
+	const byte *end = data + size;
+	PendingEventList pending;
+	timeline.sysExData.clear();
+
+	uint32 order = 0;
+
+	// All tracks are merged into the single timeline
+	for (uint16 track = 0; track < trackCount && end - pos >= 8; track++) {
+		uint32 trackSize = READ_BE_UINT32(pos + 4);
+		bool isTrack = !memcmp(pos, "MTrk", 4);
+		pos += 8;
+		const byte *trackEnd = pos + MIN<uint32>(trackSize, end - pos);
+
+		if (!isTrack) {
+			pos = trackEnd;
+			track--;
+			continue;
+		}
+
+		uint32 tick = 0;
+		byte runningStatus = 0;
+
+		while (pos < trackEnd) {
+			tick += readVLQ(pos, trackEnd);
+			if (pos >= trackEnd)
+				break;
+
+			byte status = *pos;
+			if (status < 0x80)
+				status = runningStatus;
+			else
+				pos++;
+
+			uint32 message;
+
+			if (status == 0xFF) {
+				runningStatus = 0;
+				if (pos >= trackEnd)
+					break;
+				byte type = *pos++;
+				uint32 length = MIN<uint32>(readVLQ(pos, trackEnd), trackEnd - pos);
+				if (type == 0x2F)
+					break;
+				if (type == 0x51 && length == 3)
+					addPendingEvent(pending, tick, order++, kPendingTempo, (pos[0] << 16) | (pos[1] << 8) | pos[2]);
+				pos += length;
+			} else if (status == 0xF0 || status == 0xF7) {
+				runningStatus = 0;
+				uint32 length = MIN<uint32>(readVLQ(pos, trackEnd), trackEnd - pos);
+				addPendingEvent(pending, tick, order++, kPendingSysEx, 0xF0 | (addSysEx(timeline, pos, length) << 8));
+				pos += length;
+			} else if (readChannelMessage(status, pos, trackEnd, message)) {
+				runningStatus = status;
+				addPendingEvent(pending, tick, order++, kPendingMessage, message);
+			} else {
+				warning("Invalid MIDI event %02x", status);
+				break;
+			}
+		}
+
+		pos = trackEnd;
+	}
+
+	buildTimeline(pending, division, false, timeline);
+	return true;
+}
+
+// Player
+
+MidiTimelinePlayer::MidiTimelinePlayer() {
+	_driver = 0;
+	_timeline = 0;
+	_timerRate = 0;
+	_playTime = 0;
+	_pos = 0;
+	_loopJumps = 0;
+	_latency = 0;
+	_stats = 0;
+	_startTime = 0;
+	_lastTimerCall = 0;
+	_firstEventSent = false;
+}
+
+void MidiTimelinePlayer::play(const MidiTimeline *timeline) {
+	Common::StackLock lock(_mutex);
+	stop();
+
+	_playTime = 0;
+	_pos = 0;
+	_loopJumps = timeline->loopCount ? timeline->loopCount - 1 : -1;
+	_startTime = g_system->getMillis();
+	_lastTimerCall = 0;
+	_firstEventSent = false;
+	_timeline = timeline;
+}
+
+void MidiTimelinePlayer::stop() {
+	Common::StackLock lock(_mutex);
+	if (!_timeline)
+		return;
+
+	_timeline = 0;
+	allNotesOff();
+}
+
+void MidiTimelinePlayer::allNotesOff() {
+	if (!_driver)
+		return;
+
+	for (byte i = 0; i < 16; i++)
+		_driver->send(0xB0 | i | (0x7B << 8));
+}
+
+void MidiTimelinePlayer::timerCallback(void *data) {
+	((MidiTimelinePlayer *)data)->onTimer();
+}
+
+void MidiTimelinePlayer::onTimer() {
+	Common::StackLock lock(_mutex);
+	const MidiTimeline *timeline = _timeline;
+	if (!timeline)
+		return;
+
+	_playTime += _timerRate;
+
+	uint32 sentEvents = 0;
+
+	if (_latency) {
+		uint32 now = g_system->getMillis();
+		if (_lastTimerCall)
+			_latency->record(kLatencyMidiJitter, ABS((int32)((now - _lastTimerCall) * 1000) - (int32)_timerRate));
+		_lastTimerCall = MAX<uint32>(now, 1);
+	}
+
+	const MidiTimeline::Event *events = timeline->events.begin();
+	const uint32 count = timeline->events.size();
+
+	for (;;) {
+		if (isLoopPending()) {
+			// The events before the loop end may finish well before it
+			if (_playTime < timeline->loopEndTime)
+				break;
+
+			_pos = timeline->loopStart;
+			_playTime -= timeline->loopEndTime - timeline->loopStartTime;
+			if (_loopJumps > 0)
+				_loopJumps--;
+		}
+
+		if (_pos >= count || events[_pos].time > _playTime)
+			break;
+
+		if (_latency && !_firstEventSent) {
+			_latency->record(kLatencyFirstMix, (g_system->getMillis() - _startTime) * 1000);
+			_firstEventSent = true;
+		}
+
+		uint32 data = events[_pos++].data;
+		if ((data & 0xFF) == 0xF0) {
+			const byte *sysEx = timeline->sysExData.begin() + (data >> 8);
+			_driver->sysEx(sysEx + 2, READ_LE_UINT16(sysEx));
+		} else {
+			_driver->send(data);
+		}
+
+		sentEvents++;
+	}
+
+	if (_stats) {
+		_stats->midiCallbacks++;
+		_stats->midiEventsSent += sentEvents;
+	}
+
+	// A loop ending after the last event still has to wait for its end
+	if (_pos >= count && !isLoopPending())
+		_timeline = 0;
+}
+
+bool MidiTimelinePlayer::isLoopPending() const {
+	return _pos == _timeline->loopEnd && _loopJumps != 0 && _timeline->loopEnd != _timeline->loopStart;
+}
+
+} // End of namespace StarTrek
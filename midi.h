@@ -0,0 +1,128 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef STARTREK_MIDI_H
+#define STARTREK_MIDI_H
+
+#include "common/array.h"
+#include "common/mutex.h"
+
+#include "startrek/latency.h"
+#include "startrek/stats.h"
+
+#include "sound/mididrv.h"
+
+namespace StarTrek {
+
+/**
+ * A music track converted into a flat list of MIDI messages sorted by
+ * their absolute time. Tempo changes, XMIDI note durations and XMIDI loop
+ * points are all resolved when the track is loaded.
+ */
+struct MidiTimeline {
+	struct Event {
+		uint32 time; // Microseconds from the start of the track
+		uint32 data; // Packed message as passed to MidiDriver::send()
+	};
+
+	Common::Array<Event> events;
+
+	// System exclusive messages are stored here as a 16-bit length followed
+	// by the message. Their events are 0xF0 with the offset in the upper bits.
+	Common::Array<byte> sysExData;
+
+	// Loop points as event indices; loopStart == loopEnd if there is no loop
+	uint32 loopStart, loopEnd;
+	uint32 loopStartTime, loopEndTime;
+	uint16 loopCount; // 0 loops forever
+
+	uint32 getLength() const { return events.empty() ? 0 : events.back().time; }
+};
+
+bool loadXMIDITimeline(const byte *data, uint32 size, MidiTimeline &timeline);
+bool loadSMFTimeline(const byte *data, uint32 size, MidiTimeline &timeline);
+
+/**
+ * Plays a MidiTimeline from the driver's timer. Each callback only advances
+ * the play time and sends the events that have become due. The timer runs
+ * on its own thread, so play() and stop() wait for a callback in progress;
+ * once stop() returns, the timeline may be freed.
+ */
+class MidiTimelinePlayer {
+public:
+	MidiTimelinePlayer();
+
+	void setMidiDriver(MidiDriver *driver) { _driver = driver; }
+	void setTimerRate(uint32 rate) { _timerRate = rate; }
+	void setLatency(AudioLatency *latency) { _latency = latency; }
+	void setStats(EngineStats *stats) { _stats = stats; }
+
+	void play(const MidiTimeline *timeline);
+	void stop();
+	bool isPlaying() const { return _timeline != 0; }
+	const MidiTimeline *getTimeline() const { return _timeline; }
+
+	static void timerCallback(void *data);
+	void onTimer();
+
+private:
+	Common::Mutex _mutex;
+	MidiDriver *_driver;
+	const MidiTimeline *_timeline;
+	uint32 _timerRate;
+	uint32 _playTime;
+	uint32 _pos;
+	int32 _loopJumps; // -1 to loop forever
+
+	AudioLatency *_latency;
+	EngineStats *_stats;
+	uint32 _startTime;
+	uint32 _lastTimerCall;
+	bool _firstEventSent;
+
+	void allNotesOff();
+	bool isLoopPending() const; // At the loop end with jumps left
+};
+
+// Counts and drops everything sent to it, for benchmarks and checks
+class NullMidiDriver : public MidiDriver {
+public:
+	NullMidiDriver() : _messages(0) {}
+
+	int open() { return 0; }
+	void close() {}
+	void send(uint32 b) { _messages++; }
+	void sysEx(const byte *msg, uint16 length) { _messages++; }
+	void setTimerCallback(void *timerParam, Common::TimerManager::TimerProc timerProc) {}
+	uint32 getBaseTempo() { return 1000000 / 120; }
+	MidiChannel *allocateChannel() { return 0; }
+	MidiChannel *getPercussionChannel() { return 0; }
+
+	uint32 _messages;
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -1,12 +1,28 @@
 MODULE := engines/startrek
 
 MODULE_OBJS = \
+	archive.o \
+	arena.o \
+	benchmark.o \
+	console.o \
 	detection.o \
 	font.o \
 	lzss.o \
+	macres.o \
 	graphics.o \
+	input.o \
+	latency.o \
+	membercache.o \
+	memtrack.o \
+	midi.o \
+	mve.o \
+	palette.o \
+	prefetch.o \
+	savestate.o \
+	selftest.o \
 	sound.o \
-	startrek.o
+	startrek.o \
+	verify.o
 	
 
 
@@ -0,0 +1,731 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#include "startrek/input.h"
+#include "startrek/latency.h"
+#include "startrek/memtrack.h"
+#include "startrek/mve.h"
+
+#include "common/endian.h"
+#include "common/system.h"
+#include "common/util.h"
+
+#include "sound/decoders/raw.h"
+
+namespace StarTrek {
+
+static const char MVE_SIGNATURE[] = "Interplay MVE File\x1A";
+
+enum {
+	kOpcodeEndOfStream  = 0x00,
+	kOpcodeEndOfChunk   = 0x01,
+	kOpcodeCreateTimer  = 0x02,
+	kOpcodeInitAudio    = 0x03,
+	kOpcodeStartAudio   = 0x04,
+	kOpcodeInitVideo    = 0x05,
+	kOpcodeShowFrame    = 0x07,
+	kOpcodeAudioFrame   = 0x08,
+	kOpcodeAudioSilence = 0x09,
+	kOpcodeVideoMode    = 0x0A,
+	kOpcodeSetPalette   = 0x0C,
+	kOpcodeDecodingMap  = 0x0F,
+	kOpcodeVideoData    = 0x11
+};
+
+// Delta table for Interplay's 16-bit DPCM audio
+static const int16 dpcmDeltaTable[256] = {
+	     0,      1,      2,      3,      4,      5,      6,      7,
+	     8,      9,     10,     11,     12,     13,     14,     15,
+	    16,     17,     18,     19,     20,     21,     22,     23,
+	    24,     25,     26,     27,     28,     29,     30,     31,
+	    32,     33,     34,     35,     36,     37,     38,     39,
+	    40,     41,     42,     43,     47,     51,     56,     61,
+	    66,     72,     79,     86,     94,    102,    112,    122,
+	   133,    145,    158,    173,    189,    206,    225,    245,
+	   267,    292,    318,    348,    379,    414,    452,    493,
+	   538,    587,    640,    699,    763,    832,    908,    991,
+	  1081,   1180,   1288,   1405,   1534,   1673,   1826,   1993,
+	  2175,   2373,   2590,   2826,   3084,   3365,   3672,   4008,
+	  4373,   4772,   5208,   5683,   6202,   6767,   7385,   8059,
+	  8794,   9597,  10472,  11428,  12471,  13609,  14851,  16206,
+	 17685,  19298,  21060,  22981,  25078,  27367,  29864,  32589,
+	-29973, -26728, -23186, -19322, -15105, -10503,  -5481,     -1,
+	     1,      1,   5481,  10503,  15105,  19322,  23186,  26728,
+	 29973, -32589, -29864, -27367, -25078, -22981, -21060, -19298,
+	-17685, -16206, -14851, -13609, -12471, -11428, -10472,  -9597,
+	 -8794,  -8059,  -7385,  -6767,  -6202,  -5683,  -5208,  -4772,
+	 -4373,  -4008,  -3672,  -3365,  -3084,  -2826,  -2590,  -2373,
+	 -2175,  -1993,  -1826,  -1673,  -1534,  -1405,  -1288,  -1180,
+	 -1081,   -991,   -908,   -832,   -763,   -699,   -640,   -587,
+	  -538,   -493,   -452,   -414,   -379,   -348,   -318,   -292,
+	  -267,   -245,   -225,   -206,   -189,   -173,   -158,   -145,
+	  -133,   -122,   -112,   -102,    -94,    -86,    -79,    -72,
+	   -66,    -61,    -56,    -51,    -47,    -43,    -42,    -41,
+	   -40,    -39,    -38,    -37,    -36,    -35,    -34,    -33,
+	   -32,    -31,    -30,    -29,    -28,    -27,    -26,    -25,
+	   -24,    -23,    -22,    -21,    -20,    -19,    -18,    -17,
+	   -16,    -15,    -14,    -13,    -12,    -11,    -10,     -9,
+	    -8,     -7,     -6,     -5,     -4,     -3,     -2,     -1
+};
+
+MVEDecoder::MVEDecoder(Audio::Mixer *mixer) : _mixer(mixer) {
+	_stream = 0;
+	_memoryTracker = 0;
+	_clock = 0;
+	_latency = 0;
+	_chunkBuffer = 0;
+	_chunkBufferSize = 0;
+	_frameBuffers[0] = _frameBuffers[1] = 0;
+	_decodingMap = 0;
+	_audioStream = 0;
+	_audioEnabled = (mixer != 0);
+	close();
+}
+
+MVEDecoder::~MVEDecoder() {
+	close();
+	freeBuffer(_chunkBuffer);
+}
+
+void *MVEDecoder::allocateBuffer(uint32 size, const char *what) {
+	void *data = calloc(MAX<uint32>(size, 1), 1);
+	if (_memoryTracker)
+		_memoryTracker->track(data, kMemMovie, _name + ' ' + what, size);
+	return data;
+}
+
+void MVEDecoder::freeBuffer(void *data) {
+	if (_memoryTracker)
+		_memoryTracker->untrack(data);
+	free(data);
+}
+
+bool MVEDecoder::loadStream(Common::SeekableReadStream *stream) {
+	close();
+
+	if (!stream)
+		return false;
+
+	char signature[sizeof(MVE_SIGNATURE)];
+	stream->read(signature, sizeof(signature));
+
+	// The signature is followed by three magic words
+	uint16 magic1 = stream->readUint16LE();
+	uint16 magic2 = stream->readUint16LE();
+	uint16 magic3 = stream->readUint16LE();
+
+	if (memcmp(signature, MVE_SIGNATURE, sizeof(MVE_SIGNATURE)) || magic1 != 0x001A || magic2 != 0x0100 || magic3 != 0x1133) {
+		warning("Invalid MVE header");
+		delete stream;
+		return false;
+	}
+
+	_stream = stream;
+	_endOfStream = false;
+	return true;
+}
+
+void MVEDecoder::close() {
+	if (_audioStream) {
+		if (_audioStarted)
+			_mixer->stopHandle(_audioHandle); // The mixer owns the stream
+		else
+			delete _audioStream;
+		_audioStream = 0;
+	}
+
+	delete _stream;
+	_stream = 0;
+
+	freeBuffer(_frameBuffers[0]);
+	freeBuffer(_frameBuffers[1]);
+	_frameBuffers[0] = _frameBuffers[1] = 0;
+	_curBuf = _prevBuf = 0;
+	freeBuffer(_decodingMap);
+	_decodingMap = 0;
+	_decodingMapSize = 0;
+
+	_width = _height = 0;
+	_surface.pixels = 0;
+	_surface.w = _surface.h = _surface.pitch = 0;
+	_surface.bytesPerPixel = 1;
+
+	memset(_palette, 0, sizeof(_palette));
+	_dirtyPalette = false;
+
+	_endOfStream = true;
+	_frameReady = false;
+	_frameDelay = 1000000 / 15;
+	_curFrame = 0;
+	_nextFrameMillis = 0;
+	_nextFrameMicros = 0;
+
+	_audioStarted = false;
+	_audioStereo = false;
+	_audio16Bit = false;
+	_audioCompressed = false;
+}
+
+uint32 MVEDecoder::getMillis() const {
+	return _clock ? _clock->getTime() : g_system->getMillis();
+}
+
+uint32 MVEDecoder::getTimeToNextFrame() const {
+	// Headless decoding and the first frame are never delayed
+	if (!_audioEnabled || _curFrame == 0)
+		return 0;
+
+	uint32 curMillis = getMillis();
+	if (curMillis >= _nextFrameMillis)
+		return 0;
+
+	return _nextFrameMillis - curMillis;
+}
+
+const ::Graphics::Surface *MVEDecoder::decodeNextFrame() {
+	_frameReady = false;
+
+	while (!_frameReady && !_endOfStream) {
+		if (!processChunk())
+			_endOfStream = true;
+	}
+
+	if (!_frameReady)
+		return 0;
+
+	// Schedule the following frame relative to the previous one so that
+	// slow frames do not accumulate drift
+	if (_curFrame == 0)
+		_nextFrameMillis = getMillis();
+	_nextFrameMicros += _frameDelay;
+	_nextFrameMillis += _nextFrameMicros / 1000;
+	_nextFrameMicros %= 1000;
+
+	_curFrame++;
+	return &_surface;
+}
+
+bool MVEDecoder::processChunk() {
+	uint16 chunkSize = _stream->readUint16LE();
+	_stream->readUint16LE(); // Chunk type; the opcodes tell us everything
+
+	if (_stream->eos() || _stream->err())
+		return false;
+
+	// Only the current chunk is kept in memory, in a buffer that is reused
+	if (chunkSize > _chunkBufferSize) {
+		freeBuffer(_chunkBuffer);
+		_chunkBuffer = (byte *)allocateBuffer(chunkSize, "chunk");
+		_chunkBufferSize = chunkSize;
+	}
+
+	if (_stream->read(_chunkBuffer, chunkSize) != chunkSize)
+		return false;
+
+	const byte *ptr = _chunkBuffer;
+	const byte *end = _chunkBuffer + chunkSize;
+
+	while (end - ptr >= 4 && !_endOfStream) {
+		uint16 opSize = READ_LE_UINT16(ptr);
+		byte opType = ptr[2];
+		byte opVersion = ptr[3];
+		ptr += 4;
+
+		if (opSize > end - ptr) {
+			warning("Truncated MVE opcode %02x", opType);
+			return false;
+		}
+
+		if (opType == kOpcodeEndOfChunk)
+			break;
+
+		processOpcode(opType, opVersion, ptr, opSize);
+		ptr += opSize;
+	}
+
+	return true;
+}
+
+void MVEDecoder::processOpcode(byte type, byte version, const byte *data, uint16 size) {
+	switch (type) {
+	case kOpcodeEndOfStream:
+		_endOfStream = true;
+		if (_audioStream)
+			_audioStream->finish();
+		break;
+	case kOpcodeCreateTimer:
+		if (size >= 6)
+			_frameDelay = READ_LE_UINT32(data) * READ_LE_UINT16(data + 4);
+		break;
+	case kOpcodeInitAudio:
+		initAudio(version, data, size);
+		break;
+	case kOpcodeStartAudio:
+		if (_audioStream && !_audioStarted) {
+			// The probe deletes the queue along with itself
+			Audio::AudioStream *stream = _audioStream;
+			if (_latency)
+				stream = new LatencyProbeStream(stream, _latency);
+			_mixer->playStream(Audio::Mixer::kPlainSoundType, &_audioHandle, stream);
+			_audioStarted = true;
+		}
+		break;
+	case kOpcodeInitVideo:
+		if (size >= 4) {
+			if (version >= 2 && size >= 8 && READ_LE_UINT16(data + 6))
+				error("True color MVE movies are not supported");
+			initVideo(READ_LE_UINT16(data) * 8, READ_LE_UINT16(data + 2) * 8);
+		}
+		break;
+	case kOpcodeShowFrame:
+		_frameReady = true;
+		break;
+	case kOpcodeAudioFrame:
+	case kOpcodeAudioSilence:
+		queueAudio(data, size, type == kOpcodeAudioSilence);
+		break;
+	case kOpcodeVideoMode:
+		// The screen mode the original player switched to; not needed
+		break;
+	case kOpcodeSetPalette:
+		setPalette(data, size);
+		break;
+	case kOpcodeDecodingMap:
+		if (size > _decodingMapSize)
+			size = _decodingMapSize;
+		memcpy(_decodingMap, data, size);
+		break;
+	case kOpcodeVideoData:
+		decodeVideo(data, size);
+		break;
+	default:
+		debug(5, "Skipping MVE opcode %02x (version %d, size %d)", type, version, size);
+		break;
+	}
+}
+
+void MVEDecoder::initVideo(uint16 width, uint16 height) {
+	if (width == _width && height == _height)
+		return;
+
+	freeBuffer(_frameBuffers[0]);
+	freeBuffer(_frameBuffers[1]);
+	freeBuffer(_decodingMap);
+
+	_width = width;
+	_height = height;
+	_frameBuffers[0] = (byte *)allocateBuffer(width * height, "frame");
+	_frameBuffers[1] = (byte *)allocateBuffer(width * height, "frame");
+	_curBuf = _frameBuffers[0];
+	_prevBuf = _frameBuffers[1];
+
+	// 4 bits per 8x8 block
+	_decodingMapSize = (width / 8) * (height / 8) / 2;
+	_decodingMap = (byte *)allocateBuffer(_decodingMapSize, "decoding map");
+
+	_surface.pixels = _curBuf;
+	_surface.w = width;
+	_surface.h = height;
+	_surface.pitch = width;
+	_surface.bytesPerPixel = 1;
+}
+
+void MVEDecoder::setPalette(const byte *data, uint16 size) {
+	if (size < 4)
+		return;
+
+	uint16 start = READ_LE_UINT16(data);
+	uint16 count = READ_LE_UINT16(data + 2);
+	data += 4;
+
+	if (start + count > 256 || count * 3 > size - 4) {
+		warning("Invalid MVE palette (%d, %d)", start, count);
+		return;
+	}
+
+	// Expand 6-bit color components
+	for (uint16 i = start; i < start + count; i++) {
+		_palette[i * 4] = *data++ << 2;
+		_palette[i * 4 + 1] = *data++ << 2;
+		_palette[i * 4 + 2] = *data++ << 2;
+		_palette[i * 4 + 3] = 0;
+	}
+
+	_dirtyPalette = true;
+}
+
+// Audio
+
+void MVEDecoder::initAudio(byte version, const byte *data, uint16 size) {
+	if (!_audioEnabled || _audioStream || size < 6)
+		return;
+
+	uint16 flags = READ_LE_UINT16(data + 2);
+	uint16 rate = READ_LE_UINT16(data + 4);
+
+	_audioStereo = (flags & 1) != 0;
+	_audio16Bit = (flags & 2) != 0;
+	_audioCompressed = version > 0 && (flags & 4);
+	_audioStream = Audio::makeQueuingAudioStream(rate, _audioStereo);
+}
+
+void MVEDecoder::queueAudio(const byte *data, uint16 size, bool silence) {
+	if (!_audioStream || size < 6)
+		return;
+
+	// Only the first audio track is played
+	uint16 streamMask = READ_LE_UINT16(data + 2);
+	uint16 streamLength = READ_LE_UINT16(data + 4);
+	if (!(streamMask & 1) || !streamLength)
+		return;
+
+	data += 6;
+	size -= 6;
+
+	byte flags = 0;
+	if (_audioStereo)
+		flags |= Audio::FLAG_STEREO;
+
+	byte *buffer = (byte *)malloc(streamLength);
+
+	if (!_audio16Bit && !_audioCompressed) {
+		flags |= Audio::FLAG_UNSIGNED;
+		if (silence)
+			memset(buffer, 0x80, streamLength);
+		else
+			memcpy(buffer, data, MIN<uint16>(size, streamLength));
+	} else if (silence) {
+		flags |= Audio::FLAG_16BITS;
+		memset(buffer, 0, streamLength);
+	} else if (!_audioCompressed) {
+		flags |= Audio::FLAG_16BITS | Audio::FLAG_LITTLE_ENDIAN;
+		memcpy(buffer, data, MIN<uint16>(size, streamLength));
+	} else {
+		// DPCM: an initial sample per channel, then one delta byte per sample
+		flags |= Audio::FLAG_16BITS;
+#ifdef SCUMM_LITTLE_ENDIAN
+		flags |= Audio::FLAG_LITTLE_ENDIAN;
+#endif
+
+		int16 *out = (int16 *)buffer;
+		int16 *outEnd = out + streamLength / 2;
+		const byte *in = data;
+		const byte *inEnd = data + size;
+		byte channels = _audioStereo ? 2 : 1;
+		int32 predictor[2] = { 0, 0 };
+
+		for (byte ch = 0; ch < channels && in + 2 <= inEnd; ch++) {
+			predictor[ch] = (int16)READ_LE_UINT16(in);
+			*out++ = predictor[ch];
+			in += 2;
+		}
+
+		byte ch = 0;
+		while (out < outEnd && in < inEnd) {
+			predictor[ch] = CLIP<int32>(predictor[ch] + dpcmDeltaTable[*in++], -32768, 32767);
+			*out++ = predictor[ch];
+			ch ^= channels - 1;
+		}
+
+		while (out < outEnd)
+			*out++ = 0;
+	}
+
+	_audioStream->queueBuffer(buffer, streamLength, DisposeAfterUse::YES, flags);
+}
+
+// Video
+
+void MVEDecoder::decodeVideo(const byte *data, uint32 size) {
+	if (size < 14 || !_curBuf)
+		return;
+
+	// The 14 byte header ends with a flags word; bit 0 swaps the buffers,
+	// which leaves the frame before last in the buffer we decode into
+	uint16 flags = READ_LE_UINT16(data + 12);
+	if (flags & 1) {
+		SWAP(_curBuf, _prevBuf);
+		_surface.pixels = _curBuf;
+	}
+
+	_dataPtr = data + 14;
+	_dataEnd = data + size;
+
+	const uint16 pitch = _width;
+	uint32 block = 0;
+
+	for (uint16 y = 0; y < _height; y += 8) {
+		byte *dst = _curBuf + y * pitch;
+
+		for (uint16 x = 0; x < _width; x += 8, block++, dst += 8) {
+			byte opcode = (_decodingMap[block >> 1] >> ((block & 1) << 2)) & 0xF;
+
+			// Fast paths for the most frequent opcodes
+			if (opcode == 0x1) {
+				// Unchanged since the frame before last, which is already here
+				continue;
+			} else if (opcode == 0x0) {
+				const byte *src = _prevBuf + (dst - _curBuf);
+				for (byte i = 0; i < 8; i++, src += pitch)
+					memcpy(dst + i * pitch, src, 8);
+			} else if (opcode == 0xE) {
+				byte color = nextByte();
+				for (byte i = 0; i < 8; i++)
+					memset(dst + i * pitch, color, 8);
+			} else {
+				decodeBlock(opcode, dst, x, y);
+			}
+		}
+	}
+}
+
+void MVEDecoder::copyBlock(byte *dst, const byte *srcBuf, int x, int y) {
+	if (x < 0 || y < 0 || x + 8 > _width || y + 8 > _height) {
+		debug(5, "MVE motion vector out of bounds (%d, %d)", x, y);
+		return;
+	}
+
+	const byte *src = srcBuf + y * _width + x;
+	for (byte i = 0; i < 8; i++, src += _width, dst += _width)
+		memcpy(dst, src, 8);
+}
+
+void MVEDecoder::fillPattern1(byte *dst, int w, int h, const byte *colors, uint32 flags) {
+	for (int y = 0; y < h; y++, dst += _width)
+		for (int x = 0; x < w; x++, flags >>= 1)
+			dst[x] = colors[flags & 1];
+}
+
+void MVEDecoder::fillPattern2(byte *dst, int w, int h, const byte *colors, uint32 lo, uint32 hi) {
+	uint32 flags = lo;
+	int count = 0;
+
+	for (int y = 0; y < h; y++, dst += _width) {
+		for (int x = 0; x < w; x++) {
+			dst[x] = colors[flags & 3];
+			flags >>= 2;
+			if (++count == 16)
+				flags = hi;
+		}
+	}
+}
+
+void MVEDecoder::decodeBlock(byte opcode, byte *dst, int x, int y) {
+	const uint16 pitch = _width;
+	byte p[8];
+
+	switch (opcode) {
+	case 0x2: {
+		// Copy from an earlier part of the current frame
+		byte b = nextByte();
+		if (b < 56)
+			copyBlock(dst, _curBuf, x + 8 + (b % 7), y + b / 7);
+		else
+			copyBlock(dst, _curBuf, x - 14 + ((b - 56) % 29), y + 8 + (b - 56) / 29);
+		break;
+	}
+	case 0x3: {
+		// Same as 0x2, with the vector negated
+		byte b = nextByte();
+		if (b < 56)
+			copyBlock(dst, _curBuf, x - (8 + (b % 7)), y - b / 7);
+		else
+			copyBlock(dst, _curBuf, x - (-14 + ((b - 56) % 29)), y - (8 + (b - 56) / 29));
+		break;
+	}
+	case 0x4: {
+		// Copy from the previous frame with a short vector
+		byte b = nextByte();
+		copyBlock(dst, _prevBuf, x - 8 + (b & 0xF), y - 8 + (b >> 4));
+		break;
+	}
+	case 0x5: {
+		// Copy from the previous frame with a long vector
+		int8 dx = (int8)nextByte();
+		int8 dy = (int8)nextByte();
+		copyBlock(dst, _prevBuf, x + dx, y + dy);
+		break;
+	}
+	case 0x6:
+		// Unused by the original encoder
+		break;
+	case 0x7:
+		// 2 colors, either per pixel or per 2x2 block
+		p[0] = nextByte();
+		p[1] = nextByte();
+		if (p[0] <= p[1]) {
+			for (byte i = 0; i < 8; i++)
+				fillPattern1(dst + i * pitch, 8, 1, p, nextByte());
+		} else {
+			uint16 flags = nextUint16LE();
+			for (byte i = 0; i < 8; i += 2) {
+				byte *row = dst + i * pitch;
+				for (byte j = 0; j < 8; j += 2, flags >>= 1)
+					row[j] = row[j + 1] = row[j + pitch] = row[j + pitch + 1] = p[flags & 1];
+			}
+		}
+		break;
+	case 0x8:
+		// 2 colors per quadrant or per half
+		p[0] = nextByte();
+		p[1] = nextByte();
+		if (p[0] <= p[1]) {
+			// Quadrants in the order top left, bottom left, top right, bottom right
+			for (byte q = 0; q < 4; q++) {
+				if (q) {
+					p[0] = nextByte();
+					p[1] = nextByte();
+				}
+				fillPattern1(dst + (q & 1) * 4 * pitch + (q >> 1) * 4, 4, 4, p, nextUint16LE());
+			}
+		} else {
+			uint32 flags = nextUint32LE();
+			p[2] = nextByte();
+			p[3] = nextByte();
+			if (p[2] <= p[3]) {
+				// Left and right halves
+				fillPattern1(dst, 4, 8, p, flags);
+				fillPattern1(dst + 4, 4, 8, p + 2, nextUint32LE());
+			} else {
+				// Top and bottom halves
+				fillPattern1(dst, 8, 4, p, flags);
+				fillPattern1(dst + 4 * pitch, 8, 4, p + 2, nextUint32LE());
+			}
+		}
+		break;
+	case 0x9:
+		// 4 colors per pixel or per 2x2, 2x1 or 1x2 block
+		for (byte i = 0; i < 4; i++)
+			p[i] = nextByte();
+		if (p[0] <= p[1]) {
+			if (p[2] <= p[3]) {
+				for (byte i = 0; i < 8; i++)
+					fillPattern2(dst + i * pitch, 8, 1, p, nextUint16LE(), 0);
+			} else {
+				uint32 flags = nextUint32LE();
+				for (byte i = 0; i < 8; i += 2) {
+					byte *row = dst + i * pitch;
+					for (byte j = 0; j < 8; j += 2, flags >>= 2)
+						row[j] = row[j + 1] = row[j + pitch] = row[j + pitch + 1] = p[flags & 3];
+				}
+			}
+		} else {
+			uint32 lo = nextUint32LE();
+			uint32 hi = nextUint32LE();
+			uint32 flags = lo;
+			if (p[2] <= p[3]) {
+				for (byte i = 0; i < 8; i++) {
+					if (i == 4)
+						flags = hi;
+					byte *row = dst + i * pitch;
+					for (byte j = 0; j < 8; j += 2, flags >>= 2)
+						row[j] = row[j + 1] = p[flags & 3];
+				}
+			} else {
+				for (byte i = 0; i < 8; i += 2) {
+					if (i == 4)
+						flags = hi;
+					byte *row = dst + i * pitch;
+					for (byte j = 0; j < 8; j++, flags >>= 2)
+						row[j] = row[j + pitch] = p[flags & 3];
+				}
+			}
+		}
+		break;
+	case 0xA:
+		// 4 colors per quadrant or per half
+		for (byte i = 0; i < 4; i++)
+			p[i] = nextByte();
+		if (p[0] <= p[1]) {
+			for (byte q = 0; q < 4; q++) {
+				if (q)
+					for (byte i = 0; i < 4; i++)
+						p[i] = nextByte();
+				fillPattern2(dst + (q & 1) * 4 * pitch + (q >> 1) * 4, 4, 4, p, nextUint32LE(), 0);
+			}
+		} else {
+			uint32 lo = nextUint32LE();
+			uint32 hi = nextUint32LE();
+			for (byte i = 4; i < 8; i++)
+				p[i] = nextByte();
+			if (p[4] <= p[5]) {
+				fillPattern2(dst, 4, 8, p, lo, hi);
+				lo = nextUint32LE();
+				hi = nextUint32LE();
+				fillPattern2(dst + 4, 4, 8, p + 4, lo, hi);
+			} else {
+				fillPattern2(dst, 8, 4, p, lo, hi);
+				lo = nextUint32LE();
+				hi = nextUint32LE();
+				fillPattern2(dst + 4 * pitch, 8, 4, p + 4, lo, hi);
+			}
+		}
+		break;
+	case 0xB:
+		// Raw pixels
+		for (byte i = 0; i < 8; i++) {
+			if (_dataEnd - _dataPtr < 8)
+				break;
+			memcpy(dst + i * pitch, _dataPtr, 8);
+			_dataPtr += 8;
+		}
+		break;
+	case 0xC:
+		// One color per 2x2 block
+		for (byte i = 0; i < 8; i += 2) {
+			byte *row = dst + i * pitch;
+			for (byte j = 0; j < 8; j += 2)
+				row[j] = row[j + 1] = row[j + pitch] = row[j + pitch + 1] = nextByte();
+		}
+		break;
+	case 0xD:
+		// One color per 4x4 quadrant
+		for (byte i = 0; i < 8; i++) {
+			if (!(i & 3)) {
+				p[0] = nextByte();
+				p[1] = nextByte();
+			}
+			memset(dst + i * pitch, p[0], 4);
+			memset(dst + i * pitch + 4, p[1], 4);
+		}
+		break;
+	case 0xF:
+		// Checkerboard of two colors
+		p[0] = nextByte();
+		p[1] = nextByte();
+		for (byte i = 0; i < 8; i++) {
+			byte *row = dst + i * pitch;
+			for (byte j = 0; j < 8; j += 2) {
+				row[j] = p[i & 1];
+				row[j + 1] = p[(i & 1) ^ 1];
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+} // End of namespace StarTrek
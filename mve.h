@@ -0,0 +1,155 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+#ifndef STARTREK_MVE_H
+#define STARTREK_MVE_H
+
+#include "common/scummsys.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+#include "graphics/surface.h"
+
+#include "sound/audiostream.h"
+#include "sound/mixer.h"
+
+namespace StarTrek {
+
+class AudioLatency;
+class InputRecorder;
+class MemoryTracker;
+
+/**
+ * Decoder for Interplay MVE movies (8bpp video only).
+ *
+ * The file is streamed one chunk at a time into a reusable buffer, so only
+ * the chunk being decoded is held in memory. Video is decoded into two
+ * frame buffers which are swapped as the stream requests, which lets the
+ * "unchanged" block opcode skip the block entirely.
+ */
+class MVEDecoder {
+public:
+	MVEDecoder(Audio::Mixer *mixer);
+	~MVEDecoder();
+
+	bool loadStream(Common::SeekableReadStream *stream);
+	void close();
+
+	// When disabled, audio chunks are skipped and frames are not paced
+	void setAudioEnabled(bool enabled) { _audioEnabled = enabled; }
+
+	// Accounts for the decoding buffers under the movie's name
+	void setMemoryTracker(MemoryTracker *tracker, const Common::String &name) { _memoryTracker = tracker; _name = name; }
+
+	// Frames are paced on the input's clock, which is virtual in a replay
+	void setClock(const InputRecorder *clock) { _clock = clock; }
+
+	// The audio is handed to the mixer through a probe, which counts the
+	// times the queue runs dry before the movie ends
+	void setLatency(AudioLatency *latency) { _latency = latency; }
+
+	bool isVideoLoaded() const { return _stream != 0; }
+	bool endOfVideo() const { return _endOfStream; }
+	uint16 getWidth() const { return _width; }
+	uint16 getHeight() const { return _height; }
+	uint32 getCurFrame() const { return _curFrame; }
+	uint32 getFrameDelay() const { return _frameDelay; }
+
+	uint32 getTimeToNextFrame() const;
+	bool needsUpdate() const { return !_endOfStream && getTimeToNextFrame() == 0; }
+
+	bool hasDirtyPalette() const { return _dirtyPalette; }
+	const byte *getPalette() { _dirtyPalette = false; return _palette; }
+
+	const ::Graphics::Surface *decodeNextFrame();
+
+private:
+	Audio::Mixer *_mixer;
+	Common::SeekableReadStream *_stream;
+	MemoryTracker *_memoryTracker;
+	Common::String _name;
+	const InputRecorder *_clock;
+	AudioLatency *_latency;
+
+	byte *_chunkBuffer;
+	uint32 _chunkBufferSize;
+	bool _endOfStream;
+	bool _frameReady;
+
+	// Timing
+	uint32 _frameDelay; // in microseconds
+	uint32 _curFrame;
+	uint32 _nextFrameMillis;
+	uint32 _nextFrameMicros;
+	uint32 getMillis() const;
+
+	// Video
+	uint16 _width, _height;
+	byte *_frameBuffers[2];
+	byte *_curBuf;
+	byte *_prevBuf;
+	byte *_decodingMap;
+	uint32 _decodingMapSize;
+	::Graphics::Surface _surface;
+	byte _palette[256 * 4];
+	bool _dirtyPalette;
+
+	const byte *_dataPtr;
+	const byte *_dataEnd;
+
+	// Audio
+	bool _audioEnabled;
+	bool _audioStarted;
+	bool _audioStereo;
+	bool _audio16Bit;
+	bool _audioCompressed;
+	Audio::QueuingAudioStream *_audioStream;
+	Audio::SoundHandle _audioHandle;
+
+	void *allocateBuffer(uint32 size, const char *what);
+	void freeBuffer(void *data);
+
+	bool processChunk();
+	void processOpcode(byte type, byte version, const byte *data, uint16 size);
+
+	void initVideo(uint16 width, uint16 height);
+	void initAudio(byte version, const byte *data, uint16 size);
+	void queueAudio(const byte *data, uint16 size, bool silence);
+	void setPalette(const byte *data, uint16 size);
+	void decodeVideo(const byte *data, uint32 size);
+
+	inline byte nextByte() { return (_dataPtr < _dataEnd) ? *_dataPtr++ : 0; }
+	inline uint16 nextUint16LE() { uint16 val = nextByte(); return val | (nextByte() << 8); }
+	inline uint32 nextUint32LE() { uint32 val = nextUint16LE(); return val | (nextUint16LE() << 16); }
+
+	void copyBlock(byte *dst, const byte *srcBuf, int x, int y);
+	void fillPattern1(byte *dst, int w, int h, const byte *colors, uint32 flags);
+	void fillPattern2(byte *dst, int w, int h, const byte *colors, uint32 lo, uint32 hi);
+	void decodeBlock(byte opcode, byte *dst, int x, int y);
+};
+
+} // End of namespace StarTrek
+
+#endif
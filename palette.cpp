@@ -0,0 +1,222 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/palette.h"
+
+#include "common/util.h"
+
+namespace StarTrek {
+
+byte PaletteEffects::s_scale[FADE_STEPS + 1][256];
+
+void PaletteEffects::initScaleTable() {
+	for (uint16 level = 0; level <= FADE_STEPS; level++)
+		for (uint16 value = 0; value < 256; value++)
+			s_scale[level][value] = value * level / FADE_STEPS;
+}
+
+PaletteEffects::PaletteEffects() {
+	if (!s_scale[FADE_STEPS][255])
+		initScaleTable();
+
+	memset(_base, 0, sizeof(_base));
+	memset(_palette, 0, sizeof(_palette));
+	_dirty = false;
+	_generation = 0;
+
+	memset(_fadeColor, 0, sizeof(_fadeColor));
+	_fadeLevel = 0;
+	_fadeTarget = 0;
+	_fadeSpeed = 0;
+	_flashFrames = 0;
+}
+
+void PaletteEffects::setBasePalette(const byte *palette, uint start, uint count) {
+	memcpy(_base + start * 4, palette, count * 4);
+	compose();
+}
+
+void PaletteEffects::startFade(uint16 target, uint16 frames) {
+	_fadeTarget = target;
+
+	if (!frames || target == _fadeLevel) {
+		_fadeLevel = target;
+		_fadeSpeed = 0;
+		compose();
+		return;
+	}
+
+	int32 distance = (int32)target - (int32)_fadeLevel;
+	int32 speed = distance / frames;
+	if (!speed)
+		speed = (distance > 0) ? 1 : -1;
+	_fadeSpeed = speed;
+}
+
+void PaletteEffects::fadeOut(byte r, byte g, byte b, uint16 frames) {
+	_fadeColor[0] = r;
+	_fadeColor[1] = g;
+	_fadeColor[2] = b;
+	_flashFrames = 0;
+	startFade(FADE_STEPS << 8, frames);
+}
+
+void PaletteEffects::fadeIn(uint16 frames) {
+	_flashFrames = 0;
+	startFade(0, frames);
+}
+
+void PaletteEffects::flash(byte r, byte g, byte b, uint16 frames) {
+	fadeOut(r, g, b, frames / 2);
+	uint16 returnFrames = MAX<uint16>(frames - frames / 2, 1);
+
+	// With less than two frames, or the palette already at the color, the
+	// fade there is over at once and update() would never turn back
+	if (!_fadeSpeed)
+		startFade(0, returnFrames);
+	else
+		_flashFrames = returnFrames;
+}
+
+void PaletteEffects::addCycle(byte start, byte count, uint16 delay, bool reverse) {
+	if (count < 2 || start + count > PALETTE_COLORS)
+		return;
+
+	Cycle cycle;
+	cycle.start = start;
+	cycle.count = count;
+	cycle.delay = MAX<uint16>(delay, 1);
+	cycle.counter = 0;
+	cycle.reverse = reverse;
+	_cycles.push_back(cycle);
+}
+
+bool PaletteEffects::update() {
+	for (uint32 i = 0; i < _cycles.size(); i++) {
+		Cycle &cycle = _cycles[i];
+		if (++cycle.counter < cycle.delay)
+			continue;
+
+		cycle.counter = 0;
+
+		byte *first = _base + cycle.start * 4;
+		byte *last = first + (cycle.count - 1) * 4;
+		byte entry[4];
+
+		if (cycle.reverse) {
+			memcpy(entry, first, 4);
+			memmove(first, first + 4, (cycle.count - 1) * 4);
+			memcpy(last, entry, 4);
+		} else {
+			memcpy(entry, last, 4);
+			memmove(first + 4, first, (cycle.count - 1) * 4);
+			memcpy(first, entry, 4);
+		}
+
+		_dirty = true;
+	}
+
+	if (_fadeSpeed) {
+		int32 level = (int32)_fadeLevel + _fadeSpeed;
+
+		if ((_fadeSpeed > 0 && level >= (int32)_fadeTarget) || (_fadeSpeed < 0 && level <= (int32)_fadeTarget)) {
+			_fadeLevel = _fadeTarget;
+			_fadeSpeed = 0;
+
+			// A flash turns back once it is at the color
+			if (_flashFrames) {
+				uint16 frames = _flashFrames;
+				_flashFrames = 0;
+				startFade(0, frames);
+			}
+		} else {
+			_fadeLevel = level;
+		}
+
+		_dirty = true;
+	}
+
+	if (!_dirty)
+		return false;
+
+	compose();
+	return true;
+}
+
+void PaletteEffects::compose() {
+	byte level = _fadeLevel >> 8;
+
+	if (level == 0) {
+		memcpy(_palette, _base, sizeof(_palette));
+	} else {
+		// Base * (1 - level) + color * level, all from the table. Both are
+		// rounded down, so the sum cannot overflow.
+		const byte *baseScale = s_scale[FADE_STEPS - level];
+		byte color[3];
+		for (byte i = 0; i < 3; i++)
+			color[i] = s_scale[level][_fadeColor[i]];
+
+		for (uint16 i = 0; i < PALETTE_COLORS * 4; i += 4) {
+			_palette[i] = baseScale[_base[i]] + color[0];
+			_palette[i + 1] = baseScale[_base[i + 1]] + color[1];
+			_palette[i + 2] = baseScale[_base[i + 2]] + color[2];
+			_palette[i + 3] = 0;
+		}
+	}
+
+	_dirty = false;
+	_generation++;
+}
+
+void PaletteEffects::saveLoadWithSerializer(Common::Serializer &s) {
+	s.syncBytes(_base, sizeof(_base));
+	s.syncBytes(_fadeColor, sizeof(_fadeColor));
+	s.syncAsUint16LE(_fadeLevel);
+	s.syncAsUint16LE(_fadeTarget);
+	s.syncAsSint16LE(_fadeSpeed);
+	s.syncAsUint16LE(_flashFrames);
+
+	uint16 cycleCount = _cycles.size();
+	s.syncAsUint16LE(cycleCount);
+	if (s.isLoading())
+		_cycles.resize(cycleCount);
+
+	for (uint16 i = 0; i < cycleCount; i++) {
+		Cycle &cycle = _cycles[i];
+		byte reverse = cycle.reverse;
+		s.syncAsByte(cycle.start);
+		s.syncAsUint16LE(cycle.count);
+		s.syncAsUint16LE(cycle.delay);
+		s.syncAsUint16LE(cycle.counter);
+		s.syncAsByte(reverse);
+		cycle.reverse = (reverse != 0);
+	}
+
+	if (s.isLoading())
+		compose();
+}
+
+} // End of namespace StarTrek
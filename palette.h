@@ -0,0 +1,108 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_PALETTE_H
+#define STARTREK_PALETTE_H
+
+#include "common/array.h"
+#include "common/scummsys.h"
+#include "common/serializer.h"
+
+namespace StarTrek {
+
+static const uint16 PALETTE_COLORS = 256;
+
+// Fades go through this many levels between the palette and the color
+static const byte FADE_STEPS = 32;
+
+/**
+ * Fades and color cycling over the game palette, advanced once a frame.
+ * Palettes have 4 bytes per entry, as OSystem::setPalette() takes them.
+ *
+ * A fade mixes every component with a single color. The products of each
+ * level with each component value are in a table built once, so a faded
+ * component is two lookups and an add. Cycles rotate their range of the
+ * base palette in place.
+ */
+class PaletteEffects {
+public:
+	PaletteEffects();
+
+	void setBasePalette(const byte *palette, uint start, uint count);
+
+	// Towards the color over the given number of frames, and back again
+	void fadeOut(byte r, byte g, byte b, uint16 frames);
+	void fadeIn(uint16 frames);
+	// Out and back in, as with a red alert
+	void flash(byte r, byte g, byte b, uint16 frames);
+	bool isFading() const { return _fadeSpeed != 0; }
+	byte getFadeLevel() const { return _fadeLevel >> 8; }
+
+	// Rotates the colors one place every delay frames
+	void addCycle(byte start, byte count, uint16 delay, bool reverse);
+	void clearCycles() { _cycles.clear(); }
+
+	// Advances one frame, returning whether the palette to show changed
+	bool update();
+	const byte *getPalette() const { return _palette; }
+
+	// Changes every time the palette to show does
+	uint32 getGeneration() const { return _generation; }
+
+	void saveLoadWithSerializer(Common::Serializer &s);
+
+private:
+	struct Cycle {
+		byte start;
+		uint16 count;
+		uint16 delay;
+		uint16 counter;
+		bool reverse;
+	};
+
+	byte _base[PALETTE_COLORS * 4];
+	byte _palette[PALETTE_COLORS * 4];
+	bool _dirty;
+	uint32 _generation;
+
+	byte _fadeColor[3];
+	uint16 _fadeLevel;  // 8.8 fixed point, 0 to FADE_STEPS
+	uint16 _fadeTarget; // The level the fade stops at
+	int16 _fadeSpeed;   // Per frame, 8.8 fixed point
+	uint16 _flashFrames; // Frames to fade back in over after a flash
+
+	Common::Array<Cycle> _cycles;
+
+	void startFade(uint16 target, uint16 frames);
+	void compose();
+
+	static byte s_scale[FADE_STEPS + 1][256];
+	static void initScaleTable();
+};
+
+} // End of namespace StarTrek
+
+#endif
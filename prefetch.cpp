@@ -0,0 +1,351 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/archive.h"
+#include "startrek/prefetch.h"
+#include "startrek/startrek.h"
+
+#include "common/algorithm.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+// Warmed files are held in memory until used, so stop reading ahead here
+static const uint32 PREFETCH_MAX_BYTES = 512 * 1024;
+
+// What the recordings say about a scene, while the manifest is built
+struct RecordedSuccessor {
+	Common::String name;
+	uint32 count;
+};
+
+struct RecordedScene {
+	Common::Array<Common::String> files; // In first use order
+	Common::HashMap<Common::String, uint32, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> waitTotal, openCount;
+	Common::Array<RecordedSuccessor> successors;
+};
+
+PrefetchManager::PrefetchManager(StarTrekEngine *vm) : _vm(vm) {
+	_recording = false;
+	_queuePos = 0;
+	_warmBytes = 0;
+}
+
+PrefetchManager::~PrefetchManager() {
+	stopRecording();
+	discardWarmFiles(0);
+}
+
+bool PrefetchManager::startRecording(const Common::String &filename) {
+	stopRecording();
+
+	if (!_log.open(filename)) {
+		warning("Could not open prefetch recording '%s'", filename.c_str());
+		return false;
+	}
+
+	_recording = true;
+	return true;
+}
+
+void PrefetchManager::stopRecording() {
+	if (!_recording)
+		return;
+
+	_log.flush();
+	_log.close();
+	_recording = false;
+}
+
+void PrefetchManager::splitFields(const Common::String &line, Common::Array<Common::String> &fields) {
+	fields.clear();
+
+	const char *start = line.c_str();
+	while (true) {
+		const char *end = strchr(start, '\t');
+		if (!end) {
+			fields.push_back(Common::String(start));
+			break;
+		}
+
+		fields.push_back(Common::String(start, end - start));
+		start = end + 1;
+	}
+}
+
+bool PrefetchManager::loadManifest(const Common::String &filename) {
+	Common::File file;
+	if (!file.open(filename)) {
+		warning("Could not open prefetch manifest '%s'", filename.c_str());
+		return false;
+	}
+
+	_manifest.clear();
+
+	Common::Array<Common::String> fields;
+	ManifestScene *scene = 0;
+
+	while (!file.eos() && !file.err()) {
+		splitFields(file.readLine(), fields);
+
+		if (fields[0] == "scene" && fields.size() >= 3) {
+			scene = &_manifest[fields[1]];
+			scene->next = fields[2];
+			scene->files.clear();
+		} else if (fields[0] == "file" && fields.size() >= 3 && scene) {
+			ManifestFile manifestFile;
+			manifestFile.name = fields[1];
+			manifestFile.waitTime = atoi(fields[2].c_str());
+			manifestFile.offset = 0;
+			scene->files.push_back(manifestFile);
+		}
+	}
+
+	debug(1, "Loaded the prefetch manifest for %d scenes", _manifest.size());
+	return !_manifest.empty();
+}
+
+bool PrefetchManager::buildManifest(const Common::Array<Common::String> &logFiles, const Common::String &manifestFile) {
+	Common::HashMap<Common::String, RecordedScene, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> scenes;
+	Common::Array<Common::String> sceneOrder;
+	Common::Array<Common::String> fields;
+
+	for (uint32 i = 0; i < logFiles.size(); i++) {
+		Common::File file;
+		if (!file.open(logFiles[i])) {
+			warning("Could not open prefetch recording '%s'", logFiles[i].c_str());
+			return false;
+		}
+
+		RecordedScene *scene = 0;
+
+		while (!file.eos() && !file.err()) {
+			splitFields(file.readLine(), fields);
+
+			if (fields[0] == "scene" && fields.size() >= 2) {
+				if (!scenes.contains(fields[1]))
+					sceneOrder.push_back(fields[1]);
+
+				RecordedScene *next = &scenes[fields[1]];
+
+				if (scene) {
+					uint32 j = 0;
+					while (j < scene->successors.size() && !scene->successors[j].name.equalsIgnoreCase(fields[1]))
+						j++;
+
+					if (j == scene->successors.size()) {
+						RecordedSuccessor successor;
+						successor.name = fields[1];
+						successor.count = 0;
+						scene->successors.push_back(successor);
+					}
+
+					scene->successors[j].count++;
+				}
+
+				scene = next;
+			} else if (fields[0] == "open" && fields.size() >= 3 && scene) {
+				if (!scene->openCount.contains(fields[1]))
+					scene->files.push_back(fields[1]);
+
+				scene->waitTotal[fields[1]] += atoi(fields[2].c_str());
+				scene->openCount[fields[1]]++;
+			}
+		}
+	}
+
+	Common::DumpFile out;
+	if (!out.open(manifestFile))
+		return false;
+
+	for (uint32 i = 0; i < sceneOrder.size(); i++) {
+		RecordedScene &scene = scenes[sceneOrder[i]];
+
+		// Predict the scene most often entered next, the first one on a tie
+		const RecordedSuccessor *next = 0;
+		for (uint32 j = 0; j < scene.successors.size(); j++) {
+			if (!next || scene.successors[j].count > next->count)
+				next = &scene.successors[j];
+		}
+
+		out.writeString(Common::String::printf("scene\t%s\t%s\n", sceneOrder[i].c_str(), next ? next->name.c_str() : ""));
+
+		for (uint32 j = 0; j < scene.files.size(); j++) {
+			const Common::String &name = scene.files[j];
+			out.writeString(Common::String::printf("file\t%s\t%d\n", name.c_str(), scene.waitTotal[name] / scene.openCount[name]));
+		}
+	}
+
+	out.flush();
+	return !out.err();
+}
+
+bool PrefetchManager::compareOffsets(const ManifestFile &a, const ManifestFile &b) {
+	return a.offset < b.offset;
+}
+
+void PrefetchManager::enterScene(const Common::String &name) {
+	if (_recording)
+		_log.writeString(Common::String::printf("scene\t%s\n", name.c_str()));
+
+	if (_manifest.empty())
+		return;
+
+	Manifest::const_iterator it = _manifest.find(name);
+	const ManifestScene *scene = (it != _manifest.end()) ? &it->_value : 0;
+
+	// Whatever was read for another scene will not be used now
+	discardWarmFiles(scene);
+	_queue.clear();
+	_queuePos = 0;
+
+	if (!scene || scene->next.empty())
+		return;
+
+	Manifest::const_iterator next = _manifest.find(scene->next);
+	if (next == _manifest.end())
+		return;
+
+	queueFiles(next->_value.files);
+}
+
+void PrefetchManager::getSceneFiles(const Common::String &name, Common::Array<Common::String> &files) const {
+	Manifest::const_iterator it = _manifest.find(name);
+	if (it == _manifest.end())
+		return;
+
+	for (uint32 i = 0; i < it->_value.files.size(); i++)
+		files.push_back(it->_value.files[i].name);
+}
+
+void PrefetchManager::getNextSceneFiles(const Common::String &name, Common::Array<Common::String> &files) const {
+	Manifest::const_iterator it = _manifest.find(name);
+	if (it == _manifest.end() || it->_value.next.empty())
+		return;
+
+	getSceneFiles(it->_value.next, files);
+}
+
+void PrefetchManager::warmScene(const Common::String &name) {
+	Manifest::const_iterator it = _manifest.find(name);
+	if (it == _manifest.end())
+		return;
+
+	Common::Array<ManifestFile> pending;
+	for (uint32 i = _queuePos; i < _queue.size(); i++)
+		pending.push_back(_queue[i]);
+
+	_queue.clear();
+	_queuePos = 0;
+	queueFiles(it->_value.files);
+
+	for (uint32 i = 0; i < pending.size(); i++)
+		_queue.push_back(pending[i]);
+}
+
+void PrefetchManager::queueFiles(const Common::Array<ManifestFile> &files) {
+	ResourceArchive *archive = _vm->getArchive();
+	uint32 first = _queue.size();
+
+	for (uint32 i = 0; i < files.size(); i++) {
+		ManifestFile file = files[i];
+		file.offset = archive->getFileOffset(file.name);
+		_queue.push_back(file);
+	}
+
+	Common::sort(_queue.begin() + first, _queue.end(), compareOffsets);
+}
+
+void PrefetchManager::pump() {
+	ResourceArchive *archive = _vm->getArchive();
+
+	while (_queuePos < _queue.size()) {
+		if (_warmBytes >= PREFETCH_MAX_BYTES) {
+			_queue.clear();
+			_queuePos = 0;
+			return;
+		}
+
+		const ManifestFile &file = _queue[_queuePos++];
+		if (_warmFiles.contains(file.name) || !archive->hasFile(file.name))
+			continue;
+
+		Common::SeekableReadStream *stream = archive->openFile(file.name);
+		if (!stream)
+			continue;
+
+		WarmFile warmFile;
+		warmFile.stream = stream;
+		warmFile.waitTime = file.waitTime;
+		_warmFiles[file.name] = warmFile;
+		_warmBytes += stream->size();
+		_vm->getStats()->filesPrefetched++;
+
+		// One file per frame
+		return;
+	}
+}
+
+Common::SeekableReadStream *PrefetchManager::takeFile(const Common::String &filename) {
+	WarmFileMap::iterator it = _warmFiles.find(filename);
+	if (it == _warmFiles.end())
+		return 0;
+
+	Common::SeekableReadStream *stream = it->_value.stream;
+	_vm->getStats()->prefetchHits++;
+	_vm->getStats()->prefetchTimeSaved += it->_value.waitTime;
+	_warmBytes -= stream->size();
+	_warmFiles.erase(it);
+	return stream;
+}
+
+void PrefetchManager::recordOpen(const Common::String &filename, uint32 waitTime) {
+	if (_recording)
+		_log.writeString(Common::String::printf("open\t%s\t%d\n", filename.c_str(), waitTime));
+}
+
+void PrefetchManager::discardWarmFiles(const ManifestScene *keep) {
+	Common::Array<Common::String> unused;
+
+	for (WarmFileMap::iterator it = _warmFiles.begin(); it != _warmFiles.end(); ++it) {
+		bool needed = false;
+		for (uint32 i = 0; keep && i < keep->files.size() && !needed; i++)
+			needed = keep->files[i].name.equalsIgnoreCase(it->_key);
+
+		if (!needed)
+			unused.push_back(it->_key);
+	}
+
+	for (uint32 i = 0; i < unused.size(); i++) {
+		WarmFile &warmFile = _warmFiles[unused[i]];
+		_warmBytes -= warmFile.stream->size();
+		delete warmFile.stream;
+		_warmFiles.erase(unused[i]);
+		_vm->getStats()->prefetchWasted++;
+	}
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,128 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_PREFETCH_H
+#define STARTREK_PREFETCH_H
+
+#include "common/array.h"
+#include "common/file.h"
+#include "common/hash-str.h"
+#include "common/hashmap.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+namespace StarTrek {
+
+class StarTrekEngine;
+
+/**
+ * Warms the resources of the scene expected next, from a manifest built
+ * out of recorded play sessions.
+ *
+ * A recording is a tab separated log of the scenes entered and the files
+ * opened in them, with the time spent waiting on each:
+ *   scene  <name>
+ *   open   <file>  <milliseconds>
+ *
+ * The manifest has, for every recorded scene, the scene most often entered
+ * after it followed by the files the scene opens, in first use order:
+ *   scene  <name>  <next scene>
+ *   file   <file>  <average milliseconds>
+ *
+ * There are no worker threads, so pump() is called from the main loop and
+ * reads one file each time, in archive order to avoid seeking back.
+ */
+class PrefetchManager {
+public:
+	PrefetchManager(StarTrekEngine *vm);
+	~PrefetchManager();
+
+	bool startRecording(const Common::String &filename);
+	void stopRecording();
+	bool isRecording() const { return _recording; }
+
+	bool loadManifest(const Common::String &filename);
+	bool hasManifest() const { return !_manifest.empty(); }
+	static bool buildManifest(const Common::Array<Common::String> &logFiles, const Common::String &manifestFile);
+
+	void enterScene(const Common::String &name);
+	// Reads ahead the scene's own files first, as after loading a game
+	void warmScene(const Common::String &name);
+	void pump();
+
+	// The files the scene opens, in first use order
+	void getSceneFiles(const Common::String &name, Common::Array<Common::String> &files) const;
+	// The files the scene expected after this one opens, in first use order
+	void getNextSceneFiles(const Common::String &name, Common::Array<Common::String> &files) const;
+
+	// Hands over a warmed stream, or returns 0 if it has not been read
+	Common::SeekableReadStream *takeFile(const Common::String &filename);
+	void recordOpen(const Common::String &filename, uint32 waitTime);
+
+	uint32 getPendingCount() const { return _queue.size() - _queuePos; }
+	uint32 getWarmCount() const { return _warmFiles.size(); }
+	uint32 getWarmBytes() const { return _warmBytes; }
+
+private:
+	struct ManifestFile {
+		Common::String name;
+		uint32 waitTime; // Average recorded wait, in milliseconds
+		uint32 offset;   // In the archive, to read the queue in order
+	};
+
+	struct ManifestScene {
+		Common::String next;
+		Common::Array<ManifestFile> files;
+	};
+
+	struct WarmFile {
+		Common::SeekableReadStream *stream;
+		uint32 waitTime;
+	};
+
+	typedef Common::HashMap<Common::String, ManifestScene, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> Manifest;
+	typedef Common::HashMap<Common::String, WarmFile, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> WarmFileMap;
+
+	StarTrekEngine *_vm;
+
+	Common::DumpFile _log;
+	bool _recording;
+
+	Manifest _manifest;
+	Common::Array<ManifestFile> _queue;
+	uint32 _queuePos;
+	WarmFileMap _warmFiles;
+	uint32 _warmBytes;
+
+	void discardWarmFiles(const ManifestScene *keep);
+	void queueFiles(const Common::Array<ManifestFile> &files);
+	static bool compareOffsets(const ManifestFile &a, const ManifestFile &b);
+	static void splitFields(const Common::String &line, Common::Array<Common::String> &fields);
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -0,0 +1,226 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/graphics.h"
+#include "startrek/prefetch.h"
+#include "startrek/savestate.h"
+#include "startrek/startrek.h"
+
+#include "common/endian.h"
+#include "common/memstream.h"
+
+#include "graphics/thumbnail.h"
+
+namespace StarTrek {
+
+static const uint32 SAVEGAME_MAGIC = MKID_BE('STRK');
+
+SaveSnapshot::SaveSnapshot(StarTrekEngine *vm) : _vm(vm) {
+	for (byte i = 0; i < kSaveSectionCount; i++) {
+		_sections[i].generation = 0;
+		_sections[i].valid = false;
+	}
+
+	_sectionsSerialized = 0;
+	_sectionsReused = 0;
+}
+
+uint32 SaveSnapshot::getTag(SaveSection section) {
+	static const uint32 tags[] = { MKID_BE('ENGN'), MKID_BE('PALT'), MKID_BE('THMB') };
+	return tags[section];
+}
+
+uint32 SaveSnapshot::getGeneration(SaveSection section) const {
+	switch (section) {
+	case kSaveSectionEngine:
+		return _vm->getSceneCount();
+	case kSaveSectionPalette:
+		return _vm->_gfx->getPaletteEffects().getGeneration();
+	case kSaveSectionThumbnail:
+		return _vm->_gfx->getScreenGeneration();
+	default:
+		return 0;
+	}
+}
+
+bool SaveSnapshot::save(Common::WriteStream *out, const Common::String &description) {
+	out->writeUint32BE(SAVEGAME_MAGIC);
+	out->writeByte(SAVEGAME_VERSION);
+	out->writeUint32LE(description.size());
+	out->write(description.c_str(), description.size());
+
+	out->writeByte(kSaveSectionCount);
+
+	for (byte i = 0; i < kSaveSectionCount; i++) {
+		SaveSection sectionId = (SaveSection)i;
+		Section &section = _sections[i];
+		uint32 generation = getGeneration(sectionId);
+
+		if (!section.valid || section.generation != generation) {
+			Common::MemoryWriteStreamDynamic buffer(DisposeAfterUse::YES);
+			serializeSection(sectionId, &buffer);
+
+			section.data.resize(buffer.size());
+			if (buffer.size())
+				memcpy(section.data.begin(), buffer.getData(), buffer.size());
+
+			section.generation = generation;
+			section.valid = true;
+			_sectionsSerialized++;
+		} else {
+			_sectionsReused++;
+		}
+
+		out->writeUint32BE(getTag(sectionId));
+		out->writeUint32LE(section.data.size());
+		if (!section.data.empty())
+			out->write(section.data.begin(), section.data.size());
+	}
+
+	out->flush();
+	return !out->err();
+}
+
+void SaveSnapshot::serializeSection(SaveSection section, Common::WriteStream *out) {
+	Common::Serializer s(0, out);
+
+	switch (section) {
+	case kSaveSectionEngine: {
+		Common::String sceneName = _vm->getSceneName();
+		syncEngineState(s, sceneName);
+		break;
+	}
+	case kSaveSectionPalette:
+		_vm->_gfx->getPaletteEffects().saveLoadWithSerializer(s);
+		break;
+	case kSaveSectionThumbnail:
+		::Graphics::saveThumbnail(*out);
+		break;
+	default:
+		break;
+	}
+}
+
+void SaveSnapshot::syncEngineState(Common::Serializer &s, Common::String &sceneName) {
+	s.syncString(sceneName);
+}
+
+bool SaveSnapshot::readHeader(Common::SeekableReadStream *in, SaveHeader &header) {
+	if (in->readUint32BE() != SAVEGAME_MAGIC)
+		return false;
+
+	header.version = in->readByte();
+
+	uint32 length = in->readUint32LE();
+	if (in->err() || length > (uint32)(in->size() - in->pos()))
+		return false;
+
+	header.description.clear();
+	for (uint32 i = 0; i < length; i++)
+		header.description += (char)in->readByte();
+
+	return !in->err();
+}
+
+::Graphics::Surface *SaveSnapshot::readThumbnail(Common::SeekableReadStream *in) {
+	byte sectionCount = in->readByte();
+
+	for (byte i = 0; i < sectionCount && !in->err(); i++) {
+		uint32 tag = in->readUint32BE();
+		uint32 size = in->readUint32LE();
+
+		if (tag == getTag(kSaveSectionThumbnail))
+			return size ? ::Graphics::loadThumbnail(*in) : 0;
+
+		in->skip(size);
+	}
+
+	return 0;
+}
+
+bool SaveSnapshot::load(Common::SeekableReadStream *in) {
+	SaveHeader header;
+	if (!readHeader(in, header)) {
+		warning("Not a Star Trek saved game");
+		return false;
+	}
+
+	if (header.version > SAVEGAME_VERSION) {
+		warning("Saved game version %d is newer than supported (%d)", header.version, SAVEGAME_VERSION);
+		return false;
+	}
+
+	byte sectionCount = in->readByte();
+
+	for (byte i = 0; i < sectionCount && !in->err(); i++) {
+		uint32 tag = in->readUint32BE();
+		uint32 size = in->readUint32LE();
+		int32 start = in->pos();
+
+		for (byte j = 0; j < kSaveSectionCount; j++) {
+			if (getTag((SaveSection)j) == tag) {
+				loadSection((SaveSection)j, in);
+				break;
+			}
+		}
+
+		in->seek(start + size);
+	}
+
+	// What is cached no longer matches the state
+	for (byte i = 0; i < kSaveSectionCount; i++)
+		_sections[i].valid = false;
+
+	return !in->err();
+}
+
+void SaveSnapshot::loadSection(SaveSection section, Common::SeekableReadStream *in) {
+	Common::Serializer s(in, 0);
+
+	switch (section) {
+	case kSaveSectionEngine: {
+		Common::String sceneName;
+		syncEngineState(s, sceneName);
+
+		// The scene's files are read ahead from the main loop, in case the
+		// manifest has them
+		if (!sceneName.empty()) {
+			_vm->changeScene(sceneName);
+			_vm->getPrefetchManager()->warmScene(sceneName);
+		}
+		break;
+	}
+	case kSaveSectionPalette:
+		_vm->_gfx->getPaletteEffects().saveLoadWithSerializer(s);
+		_vm->_gfx->refreshPalette();
+		break;
+	default:
+		// The thumbnail is only for the launcher
+		break;
+	}
+}
+
+} // End of namespace StarTrek
@@ -0,0 +1,104 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_SAVESTATE_H
+#define STARTREK_SAVESTATE_H
+
+#include "common/array.h"
+#include "common/serializer.h"
+#include "common/stream.h"
+#include "common/str.h"
+
+namespace Graphics {
+	struct Surface;
+}
+
+namespace StarTrek {
+
+class StarTrekEngine;
+
+static const byte SAVEGAME_VERSION = 1;
+
+enum SaveSection {
+	kSaveSectionEngine = 0,
+	kSaveSectionPalette,
+	kSaveSectionThumbnail,
+	kSaveSectionCount
+};
+
+struct SaveHeader {
+	byte version;
+	Common::String description;
+};
+
+/**
+ * Writes and reads saved games. A save has a header, then tagged sections
+ * which each hold their size, so unknown ones can be skipped:
+ *   "STRK", version, description (length and characters)
+ *   section count, then per section: tag, size, data
+ * The thumbnail section holds a standard ScummVM thumbnail.
+ *
+ * The sections are serialized into buffers which are kept between saves.
+ * A section is only serialized again if its state has changed since, so
+ * frequent autosaves mostly copy buffers out.
+ */
+class SaveSnapshot {
+public:
+	SaveSnapshot(StarTrekEngine *vm);
+
+	bool save(Common::WriteStream *out, const Common::String &description);
+	bool load(Common::SeekableReadStream *in);
+
+	static bool readHeader(Common::SeekableReadStream *in, SaveHeader &header);
+	// For the launcher; call after readHeader(). Returns 0 if there is none.
+	static ::Graphics::Surface *readThumbnail(Common::SeekableReadStream *in);
+
+	uint32 getSectionsSerialized() const { return _sectionsSerialized; }
+	uint32 getSectionsReused() const { return _sectionsReused; }
+
+private:
+	struct Section {
+		uint32 generation; // Of the state in data
+		bool valid;
+		Common::Array<byte> data;
+	};
+
+	StarTrekEngine *_vm;
+	Section _sections[kSaveSectionCount];
+	uint32 _sectionsSerialized;
+	uint32 _sectionsReused;
+
+	uint32 getGeneration(SaveSection section) const;
+	void serializeSection(SaveSection section, Common::WriteStream *out);
+	void loadSection(SaveSection section, Common::SeekableReadStream *in);
+	void syncEngineState(Common::Serializer &s, Common::String &sceneName);
+
+	static uint32 getTag(SaveSection section);
+};
+
+} // End of namespace StarTrek
+
+#endif
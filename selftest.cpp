@@ -0,0 +1,221 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/selftest.h"
+#include "startrek/archive.h"
+#include "startrek/lzss.h"
+#include "startrek/midi.h"
+
+#include "common/memstream.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+static void addResult(Common::Array<Common::String> &results, uint32 &failures, const char *name, bool passed) {
+	results.push_back(Common::String::printf("%s %s", passed ? "ok  " : "FAIL", name));
+	if (!passed)
+		failures++;
+}
+
+static void addTimelineEvent(MidiTimeline &timeline, uint32 time, uint32 data) {
+	MidiTimeline::Event event;
+	event.time = time;
+	event.data = data;
+	timeline.events.push_back(event);
+}
+
+// A note held for 0.1s in a 0.5s loop starting at 0, played for 3s. The
+// loop must wait for its end time before jumping back.
+static void checkMidiLoopFromStart(uint16 loopCount, uint32 expectedMessages, bool expectPlaying, Common::Array<Common::String> &results, uint32 &failures) {
+	MidiTimeline timeline;
+	addTimelineEvent(timeline, 0, 0x403C90);
+	addTimelineEvent(timeline, 100000, 0x003C80);
+	timeline.loopStart = 0;
+	timeline.loopEnd = 2;
+	timeline.loopStartTime = 0;
+	timeline.loopEndTime = 500000;
+	timeline.loopCount = loopCount;
+
+	NullMidiDriver driver;
+	MidiTimelinePlayer player;
+	player.setMidiDriver(&driver);
+	player.setTimerRate(10000);
+	player.play(&timeline);
+
+	uint32 mostPerCallback = 0;
+	for (uint32 i = 0; i < 300; i++) {
+		uint32 sent = driver._messages;
+		player.onTimer();
+		mostPerCallback = MAX<uint32>(mostPerCallback, driver._messages - sent);
+	}
+
+	bool playing = player.isPlaying();
+	player.setMidiDriver(0);
+	player.stop();
+
+	// Only one event is due at a time, so no callback may send more
+	addResult(results, failures, loopCount ? "midi: counted loop from time 0" : "midi: endless loop from time 0",
+		driver._messages == expectedMessages && mostPerCallback == 1 && playing == expectPlaying);
+}
+
+static void setIndexName(byte *entry, const char *name, const char *extension) {
+	memset(entry, 0, 11);
+	memcpy(entry, name, strlen(name));
+	memcpy(entry + 8, extension, strlen(extension));
+}
+
+// A plain entry, a three part entry and a repeat of the first name, with
+// the 24-bit offsets in the given byte order
+template<class Format>
+static void checkIndex(const char *name, const byte offsets[3][3], Common::Array<Common::String> &results, uint32 &failures) {
+	byte data[3 * 14];
+	setIndexName(data, "BRIDGE", "BMP");
+	setIndexName(data + 14, "SPEECH", "VOC");
+	setIndexName(data + 28, "BRIDGE", "BMP");
+	for (byte i = 0; i < 3; i++)
+		memcpy(data + i * 14 + 11, offsets[i], 3);
+
+	ArchiveIndex index;
+	bool complete = parseArchiveIndex<Format>(data, sizeof(data), index);
+	uint32 count = index.size();
+	ArchiveEntry bridge = index["bridge.bmp"];
+	ArchiveEntry speech = index["SPEECH.VOC"];
+
+	// The first of two entries with the same name wins
+	addResult(results, failures, name, complete && count == 2 &&
+		bridge.offset == 0x12345 && bridge.fileCount == 1 && speech.offset == 0x1234 && speech.fileCount == 3);
+
+	ArchiveIndex truncated;
+	complete = parseArchiveIndex<Format>(data, sizeof(data) - 1, truncated);
+	addResult(results, failures, Common::String::printf("%s, truncated", name).c_str(), !complete && truncated.size() == 2);
+}
+
+static void checkDemoIndex(Common::Array<Common::String> &results, uint32 &failures) {
+	static const byte entryTail[] = { 0x00, 0x01, 0x00, 0x45, 0x23, 0x01, 0x00, 0x00, 0x08 };
+	byte data[20];
+	setIndexName(data, "TITLE", "PAL");
+	memcpy(data + 11, entryTail, sizeof(entryTail));
+
+	ArchiveIndex index;
+	bool complete = parseArchiveIndex<DemoFormat>(data, sizeof(data), index);
+	ArchiveEntry title = index["TITLE.PAL"];
+
+	addResult(results, failures, "archive: demo index",
+		complete && index.size() == 1 && title.offset == 0x12345 && title.fileCount == 1 && title.size == 0x800);
+}
+
+// 0x1234 bytes stored in 0x456, and a 320x200 image at (16, 32)
+template<class Format>
+static void checkHeaders(const char *name, const byte *memberHeader, const byte *imageHeader, Common::Array<Common::String> &results, uint32 &failures) {
+	bool passed = true;
+
+	if (memberHeader) {
+		uint16 uncompressedSize, compressedSize;
+		parseMemberHeader<Format>(memberHeader, uncompressedSize, compressedSize);
+		passed = (uncompressedSize == 0x1234 && compressedSize == 0x456);
+	}
+
+	ImageHeader header;
+	parseImageHeader<Format>(imageHeader, header);
+	passed = passed && header.xoffset == 16 && header.yoffset == 32 && header.width == 320 && header.height == 200;
+
+	addResult(results, failures, name, passed);
+}
+
+static void checkArchiveParsers(Common::Array<Common::String> &results, uint32 &failures) {
+	static const byte pcOffsets[3][3] = { { 0x45, 0x23, 0x01 }, { 0x34, 0x12, 0x83 }, { 0x00, 0x00, 0x00 } };
+	static const byte amigaOffsets[3][3] = { { 0x01, 0x23, 0x45 }, { 0x83, 0x12, 0x34 }, { 0x00, 0x00, 0x00 } };
+	checkIndex<PCFormat>("archive: PC index", pcOffsets, results, failures);
+	checkIndex<AmigaFormat>("archive: Amiga index", amigaOffsets, results, failures);
+	checkDemoIndex(results, failures);
+
+	static const byte pcMember[] = { 0x34, 0x12, 0x56, 0x04 };
+	static const byte amigaMember[] = { 0x12, 0x34, 0x04, 0x56 };
+	static const byte pcImage[] = { 0x10, 0x00, 0x20, 0x00, 0x40, 0x01, 0xC8, 0x00 };
+	static const byte amigaImage[] = { 0x00, 0x10, 0x00, 0x20, 0x01, 0x40, 0x00, 0xC8 };
+	checkHeaders<PCFormat>("archive: PC headers", pcMember, pcImage, results, failures);
+	checkHeaders<AmigaFormat>("archive: Amiga headers", amigaMember, amigaImage, results, failures);
+	checkHeaders<DemoFormat>("archive: demo image header", 0, pcImage, results, failures);
+}
+
+// A two part member reads as both parts decoded and joined
+static void checkMultiPartMember(Common::Array<Common::String> &results, uint32 &failures) {
+	static const uint32 PART_SIZE = 300;
+	byte parts[2 * PART_SIZE];
+	for (uint32 i = 0; i < sizeof(parts); i++)
+		parts[i] = (i < PART_SIZE) ? (byte)(i % 7) : (byte)(i * 13);
+
+	byte *data = (byte *)malloc(2 * (MEMBER_HEADER_SIZE + PART_SIZE * 2));
+	uint32 size = 0;
+	for (byte i = 0; i < 2; i++) {
+		uint32 compressedSize;
+		byte *compressed = encodeLZSS(parts + i * PART_SIZE, PART_SIZE, compressedSize);
+		WRITE_LE_UINT16(data + size, PART_SIZE);
+		WRITE_LE_UINT16(data + size + 2, compressedSize);
+		memcpy(data + size + MEMBER_HEADER_SIZE, compressed, compressedSize);
+		size += MEMBER_HEADER_SIZE + compressedSize;
+		free(compressed);
+	}
+
+	// At offset 0, with 2 parts
+	byte entry[14];
+	setIndexName(entry, "SPEECH", "VOC");
+	entry[11] = 0x00;
+	entry[12] = 0x00;
+	entry[13] = 0x82;
+
+	IndexedArchive<PCFormat> archive(new Common::MemoryReadStream(data, size, DisposeAfterUse::YES));
+	Common::MemoryReadStream indexStream(entry, sizeof(entry));
+	bool passed = archive.loadIndex(&indexStream);
+
+	MemberInfo info;
+	Common::SeekableReadStream *stream = passed ? archive.openMember("SPEECH.VOC", info) : 0;
+	passed = stream && stream->size() == sizeof(parts) && info.partCount == 2 &&
+		info.expectedSize == sizeof(parts) && info.decodedSize == sizeof(parts);
+
+	if (passed) {
+		byte joined[sizeof(parts)];
+		passed = stream->read(joined, sizeof(joined)) == sizeof(joined) && !memcmp(joined, parts, sizeof(parts));
+	}
+
+	delete stream;
+	addResult(results, failures, "archive: multi-part member", passed);
+}
+
+uint32 runSelfTests(Common::Array<Common::String> &results) {
+	uint32 failures = 0;
+
+	checkArchiveParsers(results, failures);
+	checkMultiPartMember(results, failures);
+
+	// 6 passes in 3s, plus the note on at 3s for the endless loop
+	checkMidiLoopFromStart(0, 13, true, results, failures);
+	checkMidiLoopFromStart(3, 6, false, results, failures);
+
+	return failures;
+}
+
+} // End of namespace StarTrek
@@ -25,51 +25,113 @@
  
 #include "startrek/sound.h"
 
+#include "common/config-manager.h"
+#include "common/endian.h"
 #include "common/file.h"
 #include "common/macresman.h"
 
+#include <math.h>
+
+#include "startrek/arena.h"
+#include "startrek/macres.h"
+#include "startrek/memtrack.h"
+
 #include "sound/mods/protracker.h"
 #include "sound/decoders/raw.h"
+#include "sound/decoders/voc.h"
+#include "sound/softsynth/emumidi.h"
+#include "sound/softsynth/pcspk.h"
 
 namespace StarTrek {
 
 // Main Sound Functions
 
 Sound::Sound(StarTrekEngine *vm) : _vm(vm) {
+	_midiPlayer = 0;
+	_midiDriver = 0;
+	_useXMIDI = false;
+	_midiDevice = 0;
+
 	if (_vm->getPlatform() == Common::kPlatformPC || _vm->getPlatform() == Common::kPlatformMacintosh) {
 		// The main PC versions use XMIDI. ST25 Demo and Macintosh versions use SMF.
-		if ((_vm->getGameType() == GType_ST25 && _vm->getFeatures() & GF_DEMO) || _vm->getPlatform() == Common::kPlatformMacintosh)
-			_midiParser = MidiParser::createParser_SMF();
-		else
-			_midiParser = MidiParser::createParser_XMIDI();
+		_useXMIDI = !((_vm->getGameType() == GType_ST25 && _vm->getFeatures() & GF_DEMO) || _vm->getPlatform() == Common::kPlatformMacintosh);
 			
 		_midiDevice = MidiDriver::detectDevice(MDT_PCSPK|MDT_ADLIB|MDT_MIDI);
 		printf("device = %d\n", _midiDevice);
-		_midiDriver = MidiDriver::createMidi(_midiDevice);
-		_midiDriver->open();
-		_midiParser->setMidiDriver(_midiDriver);
-		_midiParser->setTimerRate(_midiDriver->getBaseTempo());
 	}
 
-	if (_vm->getPlatform() == Common::kPlatformMacintosh) {
-		_macAudioResFork = new Common::MacResManager();
-		if (!_macAudioResFork->open("Star Trek Audio"))
-			error("Could not open 'Star Trek Audio'");
-		assert(_macAudioResFork->hasResFork());
-	} else
-		_macAudioResFork = 0;
+	// The MIDI driver and the Macintosh audio fork are opened when first needed
+	_macAudioResFork = 0;
+	_macAudioIndex = 0;
 
 	_soundHandle = new Audio::SoundHandle();
+	_requestTime = 0;
+
+	for (byte i = 0; i < NUM_SFX_VOICES; i++) {
+		_sfxVoices[i].priority = 0;
+		_sfxVoices[i].startTime = 0;
+		_sfxVoices[i].data = 0;
+	}
+
+	_sfxResampleQuality = (SfxResampleQuality)CLIP(ConfMan.getInt("sfx_resample_quality"), (int)kResampleNearest, (int)kResampleCubic);
 }
 
 Sound::~Sound() {
-	delete _midiParser;
+	if (_midiDriver)
+		_midiDriver->setTimerCallback(0, 0);
+	if (_midiPlayer)
+		_midiPlayer->stop();
+	_curMusicTrack.clear();
+	clearMusicBank();
+	clearSoundEffectCache();
+
+	delete _midiPlayer;
 	delete _midiDriver;
 	delete _soundHandle;
+	delete _macAudioIndex;
 	delete _macAudioResFork;
 }
 
+bool Sound::initMidiDriver() {
+	if (_midiDriver)
+		return true;
+	if (_vm->getPlatform() != Common::kPlatformPC && _vm->getPlatform() != Common::kPlatformMacintosh)
+		return false;
+
+	_midiDriver = MidiDriver::createMidi(_midiDevice);
+	_midiDriver->open();
+
+	// Tracks are converted to timelines when loaded, so the timer
+	// callback does not have to parse anything
+	_midiPlayer = new MidiTimelinePlayer();
+	_midiPlayer->setMidiDriver(_midiDriver);
+	_midiPlayer->setTimerRate(_midiDriver->getBaseTempo());
+	_midiPlayer->setLatency(&_latency);
+	_midiPlayer->setStats(_vm->getStats());
+	_midiDriver->setTimerCallback(_midiPlayer, MidiTimelinePlayer::timerCallback);
+
+	_vm->traceStartup("MIDI driver opened");
+	return true;
+}
+
+MacResourceIndex *Sound::getMacAudioIndex() {
+	if (!_macAudioIndex) {
+		_macAudioResFork = new Common::MacResManager();
+		if (!_macAudioResFork->open("Star Trek Audio"))
+			error("Could not open 'Star Trek Audio'");
+		assert(_macAudioResFork->hasResFork());
+
+		// Every effect and track is looked up by name, so map the names once
+		_macAudioIndex = new MacResourceIndex(_macAudioResFork);
+		_vm->traceStartup("'Star Trek Audio' opened");
+	}
+
+	return _macAudioIndex;
+}
+
 void Sound::playSound(const char *baseSoundName) {
+	_requestTime = g_system->getMillis();
+
 	if (_vm->getPlatform() == Common::kPlatformAmiga)
 		playAmigaSound(baseSoundName);
 	else if (_vm->getPlatform() == Common::kPlatformMacintosh)
@@ -80,70 +142,639 @@ void Sound::playSound(const char *baseSoundName) {
 		playXMIDISound(baseSoundName);
 }
 
-void Sound::playSoundEffect(const char *baseSoundName) {
+void Sound::playSoundEffect(const char *baseSoundName, byte priority, byte volume) {
+	_requestTime = g_system->getMillis();
+	_effectNames[baseSoundName] = true;
+
 	if (_vm->getPlatform() == Common::kPlatformAmiga)
-		playAmigaSoundEffect(baseSoundName);
+		playAmigaSoundEffect(baseSoundName, priority, volume);
 	else if (_vm->getPlatform() == Common::kPlatformMacintosh)
-		playMacSoundEffect(baseSoundName);
+		playMacSoundEffect(baseSoundName, priority, volume);
 	else
-		error ("PC Sound Effects Not Supported");
+		startSoundEffect(baseSoundName, priority, volume);
 }
 
-// PC Functions
-
-void Sound::playSMFSound(const char *baseSoundName) {
+void Sound::preloadSoundEffect(const char *baseSoundName) {
 	Common::String soundName = baseSoundName;
-	
-	soundName += '.';
-	
-	switch (MidiDriver::getMusicType(_midiDevice)) {
-		case MT_MT32:
-			soundName += "ROL";
-			break;
-		case MT_PCSPK:
-			return; // Not supported...
-		default:
-			soundName += "ADL";
-			break;
+	_effectNames[soundName] = true;
+
+	if (_vm->getPlatform() == Common::kPlatformAmiga)
+		soundName += ".SFX";
+
+	loadSoundEffect(soundName);
+}
+
+// Sound Effect Functions
+
+// Amiga effects and raw Macintosh effects are signed 8-bit at this rate
+static const uint32 SFX_RATE = 11025;
+
+// Finds the sample data of a Macintosh 'snd ' resource holding a standard
+// sound header. Returns false if the data does not look like one.
+static bool findMacSndData(const byte *data, uint32 size, uint32 &offset, uint32 &length, uint32 &rate) {
+	if (size < 4)
+		return false;
+
+	uint16 format = READ_BE_UINT16(data);
+	uint32 pos;
+
+	if (format == 1) {
+		uint16 dataFormats = READ_BE_UINT16(data + 2);
+		pos = 4 + dataFormats * 6;
+	} else if (format == 2) {
+		pos = 4;
+	} else {
+		return false;
 	}
-	
-	debug(0, "Playing sound \'%s\'\n", soundName.c_str());
-	Common::SeekableReadStream *soundStream = _vm->openFile(soundName.c_str());
-	
-	byte *soundData = (byte *)malloc(soundStream->size());
-	soundStream->read(soundData, soundStream->size());
-	_midiParser->loadMusic(soundData, soundStream->size());
-	delete soundStream;
-	
-	_midiDriver->setTimerCallback(_midiParser, MidiParser::timerCallback);
+
+	if (pos + 2 > size)
+		return false;
+
+	uint16 commandCount = READ_BE_UINT16(data + pos);
+	pos += 2;
+
+	// Look for the bufferCmd pointing at the sound header
+	uint32 headerOffset = 0;
+	for (uint16 i = 0; i < commandCount && pos + 8 <= size; i++, pos += 8) {
+		if ((READ_BE_UINT16(data + pos) & 0x7FFF) == 0x51)
+			headerOffset = READ_BE_UINT32(data + pos + 4);
+	}
+
+	// Only the standard header (encoding 0) is used for 8-bit mono sounds
+	if (!headerOffset || headerOffset + 22 > size || data[headerOffset + 20] != 0)
+		return false;
+
+	offset = headerOffset + 22;
+	length = MIN<uint32>(READ_BE_UINT32(data + headerOffset + 4), size - offset);
+	rate = READ_BE_UINT32(data + headerOffset + 8) >> 16;
+	return rate != 0;
 }
 
-void Sound::playXMIDISound(const char *baseSoundName) {
+void Sound::stopSoundEffects() {
+	for (byte i = 0; i < NUM_SFX_VOICES; i++)
+		_vm->_mixer->stopHandle(_sfxVoices[i].handle);
+}
+
+void Sound::clearSoundEffectCache() {
+	// The voices play straight from the cached buffers
+	stopSoundEffects();
+
+	for (SfxCache::iterator it = _sfxCache.begin(); it != _sfxCache.end(); ++it)
+		_vm->getMemoryTracker()->release(it->_value.data);
+
+	_sfxCache.clear();
+}
+
+Sound::SfxSample Sound::loadSoundEffect(const Common::String &soundName) {
+	if (_sfxCache.contains(soundName)) {
+		_vm->getStats()->sfxCacheHits++;
+		return _sfxCache[soundName];
+	}
+
+	_vm->getStats()->sfxCacheMisses++;
+
+	if (_vm->getPlatform() == Common::kPlatformPC)
+		return cacheSoundEffect(soundName, renderPCSoundEffect(soundName));
+
+	Common::SeekableReadStream *sfxStream = 0;
+
+	if (_vm->getPlatform() == Common::kPlatformMacintosh) {
+		sfxStream = getMacAudioIndex()->getResource(soundName);
+		if (!sfxStream)
+			error("Could not find '%s' in 'Star Trek Audio'", soundName.c_str());
+	} else {
+		sfxStream = _vm->openFile(soundName.c_str());
+	}
+
+	ArenaScope scope(_vm->getSceneArena());
+	uint32 size = sfxStream->size();
+	byte *data = (byte *)_vm->getSceneArena()->allocate(size);
+	sfxStream->read(data, size);
+	delete sfxStream;
+
+	uint32 offset = 0, length = size, rate = SFX_RATE;
+	bool isUnsigned = false;
+	if (_vm->getPlatform() == Common::kPlatformMacintosh && findMacSndData(data, size, offset, length, rate))
+		isUnsigned = true;
+
+	byte signFlip = isUnsigned ? 0x80 : 0;
+	int16 *samples = (int16 *)_vm->getSceneArena()->allocate(length * 2);
+	for (uint32 i = 0; i < length; i++)
+		samples[i] = (int8)(data[offset + i] ^ signFlip) << 8;
+
+	return cacheSoundEffect(soundName, resampleSoundEffect(samples, length, rate));
+}
+
+Sound::SfxSample Sound::cacheSoundEffect(const Common::String &soundName, const SfxSample &sample) {
+	// Scene changes evict the effects the next scenes do not use
+	_vm->getMemoryTracker()->track(sample.data, kMemSound, soundName, sample.size);
+	_sfxCache[soundName] = sample;
+	return sample;
+}
+
+Sound::SfxSample Sound::renderPCSoundEffect(const Common::String &baseSoundName) {
+	// Digitized effects are used where the game has them, the others are
+	// synthesized from the device's MIDI data once and then kept as PCM
+	Common::String vocName = baseSoundName + ".VOC";
+	if (_vm->hasFile(vocName))
+		return decodeVOCSoundEffect(vocName);
+
+	if (isPCSpeaker()) {
+		Common::String pcName = baseSoundName + ".PC";
+		if (_vm->hasFile(pcName))
+			return renderPCSpeakerEffect(pcName);
+	} else {
+		return renderMidiEffect(baseSoundName);
+	}
+
+	warning("Could not find sound effect '%s'", baseSoundName.c_str());
+	SfxSample sample = { 0, 0 };
+	return sample;
+}
+
+Sound::SfxSample Sound::decodeVOCSoundEffect(const Common::String &soundName) {
+	Audio::SeekableAudioStream *vocStream = Audio::makeVOCStream(_vm->openFile(soundName), Audio::FLAG_UNSIGNED, DisposeAfterUse::YES);
+	if (!vocStream) {
+		warning("Could not decode '%s'", soundName.c_str());
+		SfxSample sample = { 0, 0 };
+		return sample;
+	}
+
+	Common::Array<int16> samples;
+	int16 buffer[1024];
+	int count;
+
+	while ((count = vocStream->readBuffer(buffer, ARRAYSIZE(buffer))) > 0) {
+		if (vocStream->isStereo()) {
+			for (int i = 0; i + 1 < count; i += 2)
+				samples.push_back((buffer[i] + buffer[i + 1]) / 2);
+		} else {
+			for (int i = 0; i < count; i++)
+				samples.push_back(buffer[i]);
+		}
+	}
+
+	uint32 rate = vocStream->getRate();
+	delete vocStream;
+
+	return resampleSoundEffect(samples.empty() ? 0 : &samples[0], samples.size(), rate);
+}
+
+bool Sound::loadEffectTimeline(const Common::String &soundName, MidiTimeline &timeline) {
+	Common::SeekableReadStream *sfxStream = _vm->openFile(soundName);
+
+	ArenaScope scope(_vm->getSceneArena());
+	uint32 size = sfxStream->size();
+	byte *data = (byte *)_vm->getSceneArena()->allocate(size);
+	sfxStream->read(data, size);
+	delete sfxStream;
+
+	bool loaded = _useXMIDI ? loadXMIDITimeline(data, size, timeline) : loadSMFTimeline(data, size, timeline);
+	if (!loaded)
+		warning("Could not load '%s'", soundName.c_str());
+	return loaded;
+}
+
+Sound::SfxSample Sound::renderPCSpeakerEffect(const Common::String &soundName) {
+	MidiTimeline timeline;
+	SfxSample sample = { 0, 0 };
+	if (!loadEffectTimeline(soundName, timeline))
+		return sample;
+
+	// Render straight at the output rate, the speaker is a single voice
+	// playing the most recent note
+	uint32 outputRate = _vm->_mixer->getOutputRate();
+	uint32 outSamples = (uint32)((double)timeline.getLength() * outputRate / 1000000);
+
+	sample.size = outSamples * 2;
+	sample.data = (int16 *)calloc(MAX<uint32>(outSamples, 1), 2);
+
+	Audio::PCSpeaker speaker(outputRate);
+	int note = -1;
+	uint32 pos = 0;
+
+	for (uint32 i = 0; i < timeline.events.size(); i++) {
+		const MidiTimeline::Event &event = timeline.events[i];
+		uint32 eventPos = MIN<uint32>((uint32)((double)event.time * outputRate / 1000000), outSamples);
+
+		if (note >= 0 && eventPos > pos)
+			speaker.readBuffer(sample.data + pos, eventPos - pos);
+		pos = eventPos;
+
+		byte status = event.data & 0xF0;
+		byte eventNote = (event.data >> 8) & 0x7F;
+		byte velocity = (event.data >> 16) & 0x7F;
+
+		if (status == 0x90 && velocity) {
+			note = eventNote;
+			speaker.play(Audio::PCSpeaker::kWaveFormSquare, (int)(440.0 * pow(2.0, (note - 69) / 12.0)), -1);
+		} else if ((status == 0x80 || status == 0x90) && eventNote == note) {
+			note = -1;
+			speaker.stop();
+		}
+	}
+
+	return sample;
+}
+
+bool Sound::isPCSpeaker() const {
+	return MidiDriver::getMusicType(_midiDevice) == MT_PCSPK;
+}
+
+static bool isEmulatedDevice(uint32 device) {
+	return MidiDriver::getMusicType(device) == MT_ADLIB || MidiDriver::getDeviceString(device, MidiDriver::kDriverId) == "mt32";
+}
+
+// Time given to the last notes to die away
+static const uint32 MIDI_EFFECT_RELEASE = 250000;
+
+Sound::SfxSample Sound::renderMidiEffect(const Common::String &baseSoundName) {
+	SfxSample sample = { 0, 0 };
+
+	// Effects get a synth of their own, so they never touch the driver
+	// playing the music. A real MIDI device cannot be read back, so its
+	// users get the AdLib versions rendered through the AdLib emulator.
+	uint32 device = _midiDevice;
+	Common::String trackName = getMusicTrackName(baseSoundName.c_str());
+	if (!isEmulatedDevice(device)) {
+		device = MidiDriver::detectDevice(MDT_ADLIB);
+		trackName = baseSoundName + ((_vm->getFeatures() & GF_DEMO) ? ".ADL" : ".AD");
+	}
+
+	MidiTimeline timeline;
+	if (!isEmulatedDevice(device) || !_vm->hasFile(trackName)) {
+		warning("Could not find sound effect '%s'", baseSoundName.c_str());
+		return sample;
+	}
+	if (!loadEffectTimeline(trackName, timeline))
+		return sample;
+
+	MidiDriver *driver = MidiDriver::createMidi(device);
+	MidiDriver_Emulated *synth = static_cast<MidiDriver_Emulated *>(driver);
+	if (synth->open() != 0) {
+		warning("Could not open a synth for '%s'", trackName.c_str());
+		delete driver;
+		return sample;
+	}
+
+	// The synth puts itself on the mixer when opened. Pausing the mixer
+	// keeps the mixer thread from reading it while it is rendered here.
+	_vm->_mixer->pauseAll(true);
+
+	uint32 rate = synth->getRate();
+	bool stereo = synth->isStereo();
+	uint32 total = (uint32)((double)(timeline.getLength() + MIDI_EFFECT_RELEASE) * rate / 1000000);
+	Common::Array<int16> samples;
+	int16 buffer[1024];
+	uint32 pos = 0, i = 0;
+
+	while (pos < total) {
+		const MidiTimeline::Event *events = timeline.events.begin();
+		uint32 nextPos = total;
+
+		for (; i < timeline.events.size(); i++) {
+			uint32 eventPos = (uint32)((double)events[i].time * rate / 1000000);
+			if (eventPos > pos) {
+				nextPos = MIN(nextPos, eventPos);
+				break;
+			}
+
+			uint32 data = events[i].data;
+			if ((data & 0xFF) == 0xF0) {
+				const byte *sysEx = timeline.sysExData.begin() + (data >> 8);
+				synth->sysEx(sysEx + 2, READ_LE_UINT16(sysEx));
+			} else {
+				synth->send(data);
+			}
+		}
+
+		uint32 count = MIN<uint32>(nextPos - pos, stereo ? ARRAYSIZE(buffer) / 2 : ARRAYSIZE(buffer));
+		synth->readBuffer(buffer, stereo ? count * 2 : count);
+
+		for (uint32 j = 0; j < count; j++)
+			samples.push_back(stereo ? (buffer[j * 2] + buffer[j * 2 + 1]) / 2 : buffer[j]);
+		pos += count;
+	}
+
+	synth->close();
+	_vm->_mixer->pauseAll(false);
+	delete driver;
+
+	return resampleSoundEffect(samples.empty() ? 0 : &samples[0], samples.size(), rate);
+}
+
+Sound::SfxSample Sound::resampleSoundEffect(const int16 *data, uint32 size, uint32 rate) {
+	uint32 outputRate = _vm->_mixer->getOutputRate();
+	uint32 outSamples = size ? (uint32)((double)size * outputRate / rate) : 0;
+
+	SfxSample sample;
+	sample.size = outSamples * 2;
+	sample.data = (int16 *)malloc(MAX<uint32>(sample.size, 2));
+
+	// 16.16 fixed point position in the source
+	uint32 step = (uint32)(((double)rate * 65536) / outputRate);
+	uint32 pos = 0;
+	int16 *out = sample.data;
+
+#define SAMPLE(i) (data[MIN<uint32>(i, size - 1)])
+
+	switch (_sfxResampleQuality) {
+	case kResampleNearest:
+		for (uint32 i = 0; i < outSamples; i++, pos += step)
+			*out++ = SAMPLE(pos >> 16);
+		break;
+	case kResampleLinear:
+		for (uint32 i = 0; i < outSamples; i++, pos += step) {
+			uint32 index = pos >> 16;
+			int32 frac = (pos & 0xFFFF) >> 1;
+			int32 a = SAMPLE(index);
+			int32 b = SAMPLE(index + 1);
+			*out++ = a + (((b - a) * frac) >> 15);
+		}
+		break;
+	case kResampleCubic:
+		for (uint32 i = 0; i < outSamples; i++, pos += step) {
+			uint32 index = pos >> 16;
+			double t = (pos & 0xFFFF) / 65536.0;
+			double p0 = SAMPLE(index ? index - 1 : 0);
+			double p1 = SAMPLE(index);
+			double p2 = SAMPLE(index + 1);
+			double p3 = SAMPLE(index + 2);
+			// Catmull-Rom spline
+			double v = p1 + 0.5 * t * (p2 - p0 + t * (2 * p0 - 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+			*out++ = (int16)CLIP<double>(v, -32768, 32767);
+		}
+		break;
+	}
+
+#undef SAMPLE
+
+	return sample;
+}
+
+Sound::SfxVoice *Sound::allocateSfxVoice(byte priority) {
+	SfxVoice *victim = 0;
+
+	for (byte i = 0; i < NUM_SFX_VOICES; i++) {
+		SfxVoice *voice = &_sfxVoices[i];
+
+		if (!_vm->_mixer->isSoundHandleActive(voice->handle))
+			return voice;
+
+		if (!victim || voice->priority < victim->priority || (voice->priority == victim->priority && voice->startTime < victim->startTime))
+			victim = voice;
+	}
+
+	// Never cut off an effect that matters more than the new one
+	if (victim->priority > priority)
+		return 0;
+
+	_vm->_mixer->stopHandle(victim->handle);
+	return victim;
+}
+
+void Sound::startSoundEffect(const Common::String &soundName, byte priority, byte volume) {
+	SfxSample sample = loadSoundEffect(soundName);
+	if (!sample.size)
+		return;
+
+	SfxVoice *voice = allocateSfxVoice(priority);
+	if (!voice) {
+		debug(1, "No free voice for sound effect '%s'", soundName.c_str());
+		return;
+	}
+
+	voice->priority = priority;
+	voice->startTime = _vm->getMillis();
+	voice->data = sample.data;
+
+	byte flags = Audio::FLAG_16BITS;
+#ifdef SCUMM_LITTLE_ENDIAN
+	flags |= Audio::FLAG_LITTLE_ENDIAN;
+#endif
+
+	Audio::AudioStream *audStream = Audio::makeRawStream((const byte *)sample.data, sample.size, _vm->_mixer->getOutputRate(), flags, DisposeAfterUse::NO);
+	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, &voice->handle, makeProbeStream(audStream), -1, volume);
+}
+
+Audio::AudioStream *Sound::makeProbeStream(Audio::AudioStream *stream) {
+	_latency.record(kLatencyRequest, (g_system->getMillis() - _requestTime) * 1000);
+	return new LatencyProbeStream(stream, &_latency);
+}
+
+// Music Bank Functions
+
+void Sound::preloadSound(const char *baseSoundName) {
+	if (_vm->getPlatform() == Common::kPlatformAmiga)
+		return;
+
+	Common::String trackName = getMusicTrackName(baseSoundName);
+	if (!trackName.empty())
+		loadMusicTrack(trackName);
+}
+
+void Sound::preloadSceneSounds(const Common::Array<Common::String> &files) {
+	for (uint32 i = 0; i < files.size(); i++) {
+		const char *dot = strrchr(files[i].c_str(), '.');
+		if (!dot)
+			continue;
+
+		Common::String baseSoundName(files[i].c_str(), dot - files[i].c_str());
+		Common::String extension(dot);
+
+		// Effects first, as music tracks use some of the same extensions
+		if (isSceneEffectFile(baseSoundName, extension))
+			preloadSoundEffect(baseSoundName.c_str());
+		else if (getMusicTrackName(baseSoundName.c_str()).equalsIgnoreCase(files[i]))
+			preloadSound(baseSoundName.c_str());
+	}
+}
+
+bool Sound::isSceneEffectFile(const Common::String &baseSoundName, const Common::String &extension) {
+	if (extension.equalsIgnoreCase(".VOC") || extension.equalsIgnoreCase(".SFX"))
+		return true;
+
+	// The MIDI versions of the PC effects look like tracks
+	return _vm->getPlatform() == Common::kPlatformPC && _effectNames.contains(baseSoundName);
+}
+
+void Sound::evictSceneSounds(const Common::Array<Common::String> &keepFiles) {
+	// Tracks are keyed by their file name, PC effects by the name without
+	// the extension
+	SoundNameSet keep;
+	for (uint32 i = 0; i < keepFiles.size(); i++) {
+		keep[keepFiles[i]] = true;
+		const char *dot = strrchr(keepFiles[i].c_str(), '.');
+		if (dot)
+			keep[Common::String(keepFiles[i].c_str(), dot - keepFiles[i].c_str())] = true;
+	}
+
+	MemoryTracker *tracker = _vm->getMemoryTracker();
+	Common::Array<Common::String> evicted;
+
+	for (MusicBank::iterator it = _musicBank.begin(); it != _musicBank.end(); ++it) {
+		if (keep.contains(it->_key) || it->_key.equalsIgnoreCase(_curMusicTrack)) {
+			tracker->retain(it->_value);
+		} else {
+			stopMusicTrack(it->_value);
+			tracker->untrack(it->_value);
+			delete it->_value;
+			evicted.push_back(it->_key);
+		}
+	}
+
+	for (uint32 i = 0; i < evicted.size(); i++)
+		_musicBank.erase(evicted[i]);
+	evicted.clear();
+
+	for (SfxCache::iterator it = _sfxCache.begin(); it != _sfxCache.end(); ++it) {
+		if (keep.contains(it->_key)) {
+			tracker->retain(it->_value.data);
+			continue;
+		}
+
+		// The voices play straight from the cached buffers
+		for (byte i = 0; i < NUM_SFX_VOICES; i++) {
+			if (_sfxVoices[i].data == it->_value.data)
+				_vm->_mixer->stopHandle(_sfxVoices[i].handle);
+		}
+
+		tracker->release(it->_value.data);
+		evicted.push_back(it->_key);
+	}
+
+	for (uint32 i = 0; i < evicted.size(); i++)
+		_sfxCache.erase(evicted[i]);
+}
+
+void Sound::clearMusicBank() {
+	// Release every track but the one that is playing
+	MidiTimeline *curTrack = 0;
+
+	for (MusicBank::iterator it = _musicBank.begin(); it != _musicBank.end(); ++it) {
+		if (!_curMusicTrack.empty() && it->_key.equalsIgnoreCase(_curMusicTrack)) {
+			curTrack = it->_value;
+		} else {
+			stopMusicTrack(it->_value);
+			_vm->getMemoryTracker()->untrack(it->_value);
+			delete it->_value;
+		}
+	}
+
+	_musicBank.clear();
+
+	if (curTrack)
+		_musicBank[_curMusicTrack] = curTrack;
+}
+
+Common::String Sound::getMusicTrackName(const char *baseSoundName) {
+	// Macintosh tracks are resources named after the sound
+	if (_vm->getPlatform() == Common::kPlatformMacintosh)
+		return baseSoundName;
+	// Amiga music is not MIDI
+	if (_vm->getPlatform() == Common::kPlatformAmiga)
+		return "";
+
 	Common::String soundName = baseSoundName;
 	
 	soundName += '.';
-	
-	switch (MidiDriver::getMusicType(_midiDevice)) {
-		case MT_MT32:
-			soundName += "MT";
-			break;
-		case MT_PCSPK:
-			soundName += "PC";
-			break;
-		default:
-			soundName += "AD";
-			break;
+
+	if (_vm->getFeatures() & GF_DEMO) {
+		switch (MidiDriver::getMusicType(_midiDevice)) {
+			case MT_MT32:
+				soundName += "ROL";
+				break;
+			case MT_PCSPK:
+				return ""; // Not supported...
+			default:
+				soundName += "ADL";
+				break;
+		}
+	} else {
+		switch (MidiDriver::getMusicType(_midiDevice)) {
+			case MT_MT32:
+				soundName += "MT";
+				break;
+			case MT_PCSPK:
+				soundName += "PC";
+				break;
+			default:
+				soundName += "AD";
+				break;
+		}
 	}
-	
-	debug(0, "Playing sound \'%s\'\n", soundName.c_str());
-	Common::SeekableReadStream *soundStream = _vm->openFile(soundName.c_str());
-	
-	byte *soundData = (byte *)malloc(soundStream->size());
-	soundStream->read(soundData, soundStream->size());
-	_midiParser->loadMusic(soundData, soundStream->size());
+
+	return soundName;
+}
+
+Common::SeekableReadStream *Sound::openMusicStream(const Common::String &trackName) {
+	if (_vm->getPlatform() != Common::kPlatformMacintosh)
+		return _vm->openFile(trackName.c_str());
+
+	Common::SeekableReadStream *soundStream = getMacAudioIndex()->getResource(trackName);
+	if (!soundStream)
+		error("Could not find '%s' in 'Star Trek Audio'", trackName.c_str());
+	return soundStream;
+}
+
+MidiTimeline *Sound::loadMusicTrack(const Common::String &trackName) {
+	if (_musicBank.contains(trackName)) {
+		_vm->getStats()->musicBankHits++;
+		return _musicBank[trackName];
+	}
+
+	_vm->getStats()->musicBankMisses++;
+
+	Common::SeekableReadStream *soundStream = openMusicStream(trackName);
+	ArenaScope scope(_vm->getSceneArena());
+	uint32 size = soundStream->size();
+	byte *soundData = (byte *)_vm->getSceneArena()->allocate(size);
+	soundStream->read(soundData, size);
 	delete soundStream;
-	
-	_midiDriver->setTimerCallback(_midiParser, MidiParser::timerCallback);
+
+	MidiTimeline *track = new MidiTimeline();
+	bool loaded = _useXMIDI ? loadXMIDITimeline(soundData, size, *track) : loadSMFTimeline(soundData, size, *track);
+
+	if (!loaded)
+		error("Could not load music track '%s'", trackName.c_str());
+
+	uint32 trackSize = sizeof(MidiTimeline) + track->events.size() * sizeof(MidiTimeline::Event) + track->sysExData.size();
+	_vm->getMemoryTracker()->track(track, kMemSound, trackName, trackSize);
+
+	_musicBank[trackName] = track;
+	return track;
+}
+
+void Sound::stopMusicTrack(const MidiTimeline *track) {
+	// Waits for the timer callback, so the track can be freed afterwards
+	if (_midiPlayer && _midiPlayer->getTimeline() == track)
+		_midiPlayer->stop();
+}
+
+void Sound::playMusicTrack(const Common::String &trackName) {
+	debug(0, "Playing sound \'%s\'\n", trackName.c_str());
+
+	MidiTimeline *track = loadMusicTrack(trackName);
+
+	// The driver is opened on first use, which is part of the wait
+	initMidiDriver();
+	_latency.record(kLatencyRequest, (g_system->getMillis() - _requestTime) * 1000);
+	_midiPlayer->play(track);
+	_curMusicTrack = trackName;
+}
+
+// PC Functions
+
+void Sound::playSMFSound(const char *baseSoundName) {
+	Common::String trackName = getMusicTrackName(baseSoundName);
+	if (trackName.empty())
+		return;
+
+	playMusicTrack(trackName);
+}
+
+void Sound::playXMIDISound(const char *baseSoundName) {
+	playMusicTrack(getMusicTrackName(baseSoundName));
 }
 
 // Amiga Functions
@@ -159,35 +790,21 @@ void Sound::playAmigaSound(const char *baseSoundName) {
 #endif
 }
 
-void Sound::playAmigaSoundEffect(const char *baseSoundName) {
+void Sound::playAmigaSoundEffect(const char *baseSoundName, byte priority, byte volume) {
 	Common::String soundName = baseSoundName;
 	soundName += ".SFX";
 
-	if (_vm->_mixer->isSoundHandleActive(*_soundHandle))
-		_vm->_mixer->stopHandle(*_soundHandle);
-
-	Audio::AudioStream *audStream = (Audio::AudioStream *)Audio::makeRawStream(_vm->openFile(soundName.c_str()), 11025, 0);
-	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, _soundHandle, audStream);
+	startSoundEffect(soundName, priority, volume);
 }
 
 // Macintosh Functions
 
 void Sound::playMacSMFSound(const char *baseSoundName) {
-	Common::SeekableReadStream *soundStream = _macAudioResFork->getResource(baseSoundName);
-	byte *soundData = (byte *)malloc(soundStream->size());
-	soundStream->read(soundData, soundStream->size());
-	_midiParser->loadMusic(soundData, soundStream->size());
-	delete soundStream;
-	
-	_midiDriver->setTimerCallback(_midiParser, MidiParser::timerCallback);
+	playMusicTrack(getMusicTrackName(baseSoundName));
 }
 
-void Sound::playMacSoundEffect(const char *baseSoundName) {
-	if (_vm->_mixer->isSoundHandleActive(*_soundHandle))
-		_vm->_mixer->stopHandle(*_soundHandle);
-
-	Audio::AudioStream *audStream = (Audio::AudioStream *)Audio::makeRawStream(_macAudioResFork->getResource(baseSoundName), 11025, 0);
-	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, _soundHandle, audStream);
+void Sound::playMacSoundEffect(const char *baseSoundName, byte priority, byte volume) {
+	startSoundEffect(baseSoundName, priority, volume);
 }
 
 } // End of namespace StarTrek
@@ -27,8 +27,12 @@
 #define STARTREK_SOUND_H
 
 #include "startrek/startrek.h"
+#include "startrek/latency.h"
+#include "startrek/midi.h"
+
+#include "common/hash-str.h"
+#include "common/hashmap.h"
 
-#include "sound/midiparser.h"
 #include "sound/mididrv.h"
 #include "sound/mixer.h"
 
@@ -38,36 +42,120 @@ namespace Common {
 
 namespace StarTrek {
 
+class MacResourceIndex;
 class StarTrekEngine;
 
+static const byte NUM_SFX_VOICES = 8;
+
+enum SfxResampleQuality {
+	kResampleNearest = 0,
+	kResampleLinear = 1,
+	kResampleCubic = 2
+};
+
 class Sound {
 public:
 	Sound(StarTrekEngine *vm);
 	~Sound();
 	
 	void playSound(const char *baseSoundName);	
-	void playSoundEffect(const char *baseSoundName);	
+	void playSoundEffect(const char *baseSoundName, byte priority = 0, byte volume = Audio::Mixer::kMaxChannelVolume);	
+	void preloadSoundEffect(const char *baseSoundName);
+	void stopSoundEffects();
+	void clearSoundEffectCache();
+	
+	// Music bank functions
+	void preloadSound(const char *baseSoundName);
+	void clearMusicBank();
+
+	// Preloads the tracks and effects among the files a scene opens
+	void preloadSceneSounds(const Common::Array<Common::String> &files);
+	// Drops the tracks and effects not among the given files, except the
+	// music playing
+	void evictSceneSounds(const Common::Array<Common::String> &keepFiles);
+
+	AudioLatency *getLatency() { return &_latency; }
 	
 private:
 	StarTrekEngine *_vm;
 	Audio::SoundHandle *_soundHandle;
 	
+	friend class Console;
+
+	// Timing of the path from a sound request to the first mixed sample
+	AudioLatency _latency;
+	uint32 _requestTime;
+	Audio::AudioStream *makeProbeStream(Audio::AudioStream *stream);
+
+	// Music bank of converted tracks, keyed by the device specific track name
+	typedef Common::HashMap<Common::String, MidiTimeline *, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> MusicBank;
+	MusicBank _musicBank;
+	Common::String _curMusicTrack;
+
+	// Effects and music share file extensions, so the names played as
+	// effects are remembered to tell them apart when preloading
+	typedef Common::HashMap<Common::String, bool, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> SoundNameSet;
+	SoundNameSet _effectNames;
+	bool isSceneEffectFile(const Common::String &baseSoundName, const Common::String &extension);
+	
+	Common::String getMusicTrackName(const char *baseSoundName);
+	Common::SeekableReadStream *openMusicStream(const Common::String &trackName);
+	MidiTimeline *loadMusicTrack(const Common::String &trackName);
+	void playMusicTrack(const Common::String &trackName);
+	void stopMusicTrack(const MidiTimeline *track);
+	
+	// Sound effect voices. When all are busy, the effect with the lowest
+	// priority is stolen, the oldest one if several share that priority.
+	struct SfxVoice {
+		Audio::SoundHandle handle;
+		byte priority;
+		uint32 startTime;
+		const int16 *data; // The cached sample it plays
+	};
+	SfxVoice _sfxVoices[NUM_SFX_VOICES];
+
+	// Decoded effects, already resampled to the mixer's output rate so the
+	// mixer can play them without rate conversion
+	struct SfxSample {
+		int16 *data;
+		uint32 size; // in bytes
+	};
+	typedef Common::HashMap<Common::String, SfxSample, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> SfxCache;
+	SfxCache _sfxCache;
+	SfxResampleQuality _sfxResampleQuality;
+
+	SfxSample loadSoundEffect(const Common::String &soundName);
+	SfxSample cacheSoundEffect(const Common::String &soundName, const SfxSample &sample);
+	SfxSample resampleSoundEffect(const int16 *data, uint32 size, uint32 rate);
+	SfxVoice *allocateSfxVoice(byte priority);
+	void startSoundEffect(const Common::String &soundName, byte priority, byte volume);
+	
 	// PC Sound Functions
+	SfxSample renderPCSoundEffect(const Common::String &baseSoundName);
+	SfxSample decodeVOCSoundEffect(const Common::String &soundName);
+	bool loadEffectTimeline(const Common::String &soundName, MidiTimeline &timeline);
+	SfxSample renderPCSpeakerEffect(const Common::String &soundName);
+	SfxSample renderMidiEffect(const Common::String &baseSoundName);
+	bool isPCSpeaker() const;
 	void playXMIDISound(const char *baseSoundName);
 	void playSMFSound(const char *baseSoundName);
 	
 	// Macintosh Sound Functions
 	void playMacSMFSound(const char *baseSoundName);
-	void playMacSoundEffect(const char *baseSoundName);
+	void playMacSoundEffect(const char *baseSoundName, byte priority, byte volume);
 	Common::MacResManager *_macAudioResFork;
+	MacResourceIndex *_macAudioIndex;
+	MacResourceIndex *getMacAudioIndex();
 	
 	// Amiga Sound Functions
 	void playAmigaSound(const char *baseSoundName);
-	void playAmigaSoundEffect(const char *baseSoundName);
+	void playAmigaSoundEffect(const char *baseSoundName, byte priority, byte volume);
 	
 	// MIDI-Related Variables
-	MidiParser *_midiParser;
+	bool initMidiDriver();
+	MidiTimelinePlayer *_midiPlayer;
 	MidiDriver *_midiDriver;
+	bool _useXMIDI;
 	uint32 _midiDevice;	
 };
 
@@ -36,33 +36,115 @@
 
 #include "graphics/video/qt_decoder.h"
 
-#include "startrek/lzss.h"
+#include "startrek/arena.h"
+#include "startrek/archive.h"
+#include "startrek/benchmark.h"
+#include "startrek/input.h"
+#include "startrek/membercache.h"
+#include "startrek/memtrack.h"
+#include "startrek/mve.h"
+#include "startrek/prefetch.h"
+#include "startrek/savestate.h"
 #include "startrek/startrek.h"
+#include "startrek/verify.h"
 
 namespace StarTrek {
 
+// Initial size of the scene arena; it grows between scenes if needed
+static const uint32 SCENE_ARENA_SIZE = 96 * 1024;
+
 StarTrekEngine::StarTrekEngine(OSystem *syst, const StarTrekGameDescription *gamedesc) : Engine(syst), _gameDescription(gamedesc) {
+	ConfMan.registerDefault("sfx_resample_quality", 1);
+	ConfMan.registerDefault("pin_loose_files", true);
+
 	_macResFork = 0;
+	_archive = 0;
+	_memberCache = 0;
+	_console = 0;
+	_gfx = 0;
+	_sound = 0;
+	_startTime = _system->getMillis();
+
+	_sceneArena = new Arena(SCENE_ARENA_SIZE);
+	_memoryTracker = new MemoryTracker();
+	_prefetch = new PrefetchManager(this);
+	_input = new InputRecorder(this);
+	_snapshot = new SaveSnapshot(this);
+	_sceneCount = 0;
+	_lastAutosaveTime = 0;
 }
 
 StarTrekEngine::~StarTrekEngine() {
+	delete _snapshot;
+	delete _input;
+	delete _prefetch;
+	delete _console;
 	delete _gfx;
 	delete _sound;
+	delete _archive;
+	delete _memberCache;
 	delete _macResFork;
+	delete _sceneArena;
+
+	// Whatever is still accounted for now was never freed
+	_memoryTracker->reportLeaks();
+	delete _memoryTracker;
+}
+
+void StarTrekEngine::traceStartup(const char *event) {
+	StartupEvent startupEvent;
+	startupEvent.name = event;
+	startupEvent.time = _system->getMillis() - _startTime;
+	_startupTrace.push_back(startupEvent);
+
+	debug(1, "Startup: %d ms: %s", startupEvent.time, event);
 }
 
 Common::Error StarTrekEngine::run() {
+	traceStartup("Engine started");
+
+	// The font, the MIDI driver and the Macintosh audio fork are only
+	// loaded once they are used
+	_console = new Console(this);
 	_gfx = new Graphics(this);
 	_sound = new Sound(this);
+	traceStartup("Subsystems created");
+
+	// Headless benchmark run on generated data, e.g. with the null backend.
+	// It runs before any of the game's files are opened.
+	if (ConfMan.hasKey("benchmark_output")) {
+		initGraphics(320, 200, false);
+		runBenchmark(ConfMan.get("benchmark_output"));
+		return Common::kNoError;
+	}
 
 	if (getPlatform() == Common::kPlatformMacintosh) {
 		_macResFork = new Common::MacResManager();
 		if (!_macResFork->open("Star Trek Data"))
 			error("Could not load Star Trek Data");
 		assert(_macResFork->hasDataFork() && _macResFork->hasResFork());
+		traceStartup("'Star Trek Data' opened");
 	}
 
+	// The index is parsed once here, for the platform's format
+	initArchive();
+	traceStartup("Archive index loaded");
+
+	// Either record which files each scene opens, or read ahead from a
+	// manifest built out of such recordings
+	if (ConfMan.hasKey("prefetch_record"))
+		_prefetch->startRecording(ConfMan.get("prefetch_record"));
+	else if (ConfMan.hasKey("prefetch_manifest"))
+		_prefetch->loadManifest(ConfMan.get("prefetch_manifest"));
+
 	initGraphics(320, 200, false);
+	traceStartup("Graphics mode set");
+
+	// Headless check of every archive member, which can also extract them
+	if (ConfMan.hasKey("verify_output")) {
+		verifyArchive(ConfMan.get("verify_output"));
+		return Common::kNoError;
+	}
 	
 // Hexdump data
 #if 0
@@ -87,6 +169,14 @@ Common::Error StarTrekEngine::run() {
 // Judgment Rites Backgrounds supported too
 // EGA not supported
 #if 1
+	// A replay starts here, so its first tick includes the title screen
+	if (ConfMan.hasKey("input_replay"))
+		_input->startReplay(ConfMan.get("input_replay"), ConfMan.hasKey("replay_output") ? ConfMan.get("replay_output") : "replay.csv");
+	else if (ConfMan.hasKey("input_record"))
+		_input->startRecording(ConfMan.get("input_record"));
+
+	changeScene("TITLE");
+
 	if (getGameType() == GType_ST25) {
 		if (getPlatform() == Common::kPlatformMacintosh) {
 			playMovie("Voice Data/Additional Audio/Intro Movie");
@@ -109,149 +199,239 @@ Common::Error StarTrekEngine::run() {
 	} else {
 		_gfx->drawBackgroundImage("BRIDGE.BGD");
 	}
+
+	traceStartup("First frame");
+
+	// Started from the launcher's load dialog
+	if (ConfMan.hasKey("save_slot"))
+		loadGameState(ConfMan.getInt("save_slot"));
+
+	_lastAutosaveTime = getMillis();
 	
 	Common::Event event;
 	
-	while (!shouldQuit()) {
-		while (_eventMan->pollEvent(event)) {
+	while (!shouldQuit() && !_input->isReplayFinished()) {
+		while (_input->pollEvent(event)) {
 			switch (event.type) {
 				case Common::EVENT_QUIT:
 					_system->quit();
 					break;
+				case Common::EVENT_KEYDOWN:
+					if ((event.kbd.flags & Common::KBD_CTRL) && event.kbd.keycode == Common::KEYCODE_d)
+						_console->attach();
+					break;
 				default:
 					break;
 			}
 		}
+
+		_gfx->updatePaletteEffects();
+		_prefetch->pump();
+		_console->onFrame();
+		_input->endTick();
+
+		// Only what changed since the last save is serialized again, so
+		// this is cheap enough to do from the loop
+		int autosavePeriod = ConfMan.getInt("autosave_period");
+		if (autosavePeriod > 0 && getMillis() - _lastAutosaveTime >= (uint32)autosavePeriod * 1000) {
+			writeSaveState(AUTOSAVE_SLOT, "Autosave");
+			_lastAutosaveTime = getMillis();
+		}
+
+		// Replays run on a virtual clock, as fast as they can
+		if (_input->getMode() != kInputReplay)
+			_system->delayMillis(InputRecorder::TICK_MILLIS);
 	}
+
+	_input->stop();
 #endif
 
 	return Common::kNoError;
 }
 
-Common::SeekableReadStream *StarTrekEngine::openFile(Common::String filename) {
+void StarTrekEngine::initArchive() {
 	// The Judgment Rites demo has its files not in the standard archive
 	if (getGameType() == GType_STJR && (getFeatures() & GF_DEMO)) {
-		Common::File *file = new Common::File();
-		if (!file->open(filename.c_str()))
-			error ("Could not find file \'%s\'", filename.c_str());
-		return file;
+		_archive = new LooseFileArchive(Common::FSNode(ConfMan.get("path")), ConfMan.getBool("pin_loose_files"));
+		_archive->setStats(&_stats);
+		_archive->setArena(_sceneArena);
+		_archive->setMemoryTracker(_memoryTracker);
+		return;
 	}
 
 	Common::SeekableReadStream *indexFile = 0;
+	Common::SeekableReadStream *dataFile = 0;
 
 	if (getPlatform() == Common::kPlatformAmiga) {
 		indexFile = SearchMan.createReadStreamForMember("data000.dir");
 		if (!indexFile)
 			error ("Could not open data000.dir");
+		dataFile = SearchMan.createReadStreamForMember("data.000");
+		if (!dataFile)
+			error("Could not open data.000");
 	} else if (getPlatform() == Common::kPlatformMacintosh) {
 		indexFile = _macResFork->getResource("Directory");
 		if (!indexFile)
 			error("Could not find 'Directory' resource in 'Star Trek Data'");
+		dataFile = _macResFork->getDataFork();
+		if (!dataFile)
+			error("Could not get 'Star Trek Data' data fork");
 	} else {
 		indexFile = SearchMan.createReadStreamForMember("data.dir");
 		if (!indexFile)
 			error ("Could not open data.dir");
+		dataFile = SearchMan.createReadStreamForMember("data.001");
+		if (!dataFile)
+			error("Could not open data.001");
 	}
-	
-	uint32 indexOffset = 0;
-	bool foundData = false;
-	uint16 fileCount = 1;
-	uint16 uncompressedSize = 0;
-	
-	while (!indexFile->eos() && !indexFile->err()) {
-		Common::String testfile;
-		for (byte i = 0; i < 8; i++) {
-			char c = indexFile->readByte();
-			if (c)
-				testfile += c;
-		}
-		testfile += '.';
-	
-		for (byte i = 0; i < 3; i++)
-			testfile += indexFile->readByte();
-		
-		if (getFeatures() & GF_DEMO) {
-			indexFile->readByte(); // Always 0?
-			fileCount = indexFile->readUint16LE(); // Always 1
-			indexOffset = indexFile->readUint32LE();
-			uncompressedSize = indexFile->readUint16LE();
-		} else {
-			if (getPlatform() == Common::kPlatformAmiga)
-				indexOffset = (indexFile->readByte() << 16) + (indexFile->readByte() << 8) + indexFile->readByte();	
-			else 
-				indexOffset = indexFile->readByte() + (indexFile->readByte() << 8) + (indexFile->readByte() << 16);
-			
-			if (indexOffset & (1 << 23)) {
-				fileCount = (indexOffset >> 16) & 0x7F;
-				indexOffset = indexOffset & 0xFFFF;
-			
-				// TODO: Replace necessary number with ?
-			} else {
-				fileCount = 1;
-			}
-		}
-		
-		if (filename.matchString(testfile)) {
-			foundData = true;
-			break;
-		}		
+
+	// Engines on the same host can share the decompressed members
+	if (ConfMan.hasKey("member_cache_path")) {
+		Common::String gameKey = MemberCache::computeGameKey(dataFile);
+		Common::FSNode cacheDirectory(ConfMan.get("member_cache_path"));
+
+		if (gameKey.empty() || !cacheDirectory.isDirectory())
+			warning("Not using the member cache in '%s'", ConfMan.get("member_cache_path").c_str());
+		else
+			_memberCache = new MemberCache(cacheDirectory, gameKey);
 	}
-	
+
+	_archive = createArchive(indexFile, dataFile, getPlatform() == Common::kPlatformAmiga, (getFeatures() & GF_DEMO) != 0);
+	_archive->setStats(&_stats);
+	_archive->setArena(_sceneArena);
+	_archive->setMemoryTracker(_memoryTracker);
+	_archive->setMemberCache(_memberCache);
 	delete indexFile;
-	
-	if (!foundData)
-		error ("Could not find file \'%s\'", filename.c_str());
+}
 
-	Common::SeekableReadStream *dataFile = 0;
+void StarTrekEngine::changeScene(const Common::String &name) {
+	debug(1, "Leaving scene '%s' (arena high-water %d bytes), entering '%s'", _sceneName.c_str(), _sceneArena->getHighWater(), name.c_str());
+
+	_sceneArena->reset();
+	_memoryTracker->nextScene();
+	_sceneName = name;
+	_sceneCount++;
+	_prefetch->enterScene(name);
+
+	// Only the sounds of this scene and the next stay converted
+	Common::Array<Common::String> keepFiles, nextFiles;
+	_prefetch->getSceneFiles(name, keepFiles);
+	_prefetch->getNextSceneFiles(name, nextFiles);
+	for (uint32 i = 0; i < nextFiles.size(); i++)
+		keepFiles.push_back(nextFiles[i]);
+	_sound->evictSceneSounds(keepFiles);
+
+	// Convert the next scene's music and effects now, so switching to them
+	// does not wait on the archive. Not while recording, as these opens
+	// would be logged against this scene.
+	if (!_prefetch->isRecording())
+		_sound->preloadSceneSounds(nextFiles);
+}
 
-	if (getPlatform() == Common::kPlatformAmiga) {
-		dataFile = SearchMan.createReadStreamForMember("data.000");
-		if (!dataFile)
-			error("Could not open data.000");
-	} else if (getPlatform() == Common::kPlatformMacintosh) {
-		dataFile = _macResFork->getDataFork();
-		if (!dataFile)
-			error("Could not get 'Star Trek Data' data fork");
-	} else {
-		dataFile = SearchMan.createReadStreamForMember("data.001");
-		if (!dataFile)
-			error("Could not open data.001");
+void StarTrekEngine::runBenchmark(const Common::String &filename) {
+	ArchiveBenchmark benchmark(this);
+	if (ConfMan.hasKey("benchmark_members"))
+		benchmark.setMemberCount(ConfMan.getInt("benchmark_members"));
+	if (ConfMan.hasKey("benchmark_member_size"))
+		benchmark.setMemberSize(ConfMan.getInt("benchmark_member_size"));
+
+	Common::Array<Common::String> results;
+	benchmark.run(results);
+
+	if (!ArchiveBenchmark::writeResults(results, filename))
+		warning("Could not write benchmark results to '%s'", filename.c_str());
+}
+
+void StarTrekEngine::verifyArchive(const Common::String &filename) {
+	ArchiveVerifier verifier(_archive);
+	if (ConfMan.hasKey("extract_path"))
+		verifier.setExtractPath(ConfMan.get("extract_path"));
+
+	verifier.run();
+
+	Common::Array<Common::String> report;
+	verifier.getReport(report);
+
+	if (verifier.getCorruptCount())
+		warning("%d of %d archive members are corrupt", verifier.getCorruptCount(), verifier.getMembers().size());
+
+	if (!ArchiveBenchmark::writeResults(report, filename))
+		warning("Could not write the verification report to '%s'", filename.c_str());
+}
+
+uint32 StarTrekEngine::getMillis() const {
+	return _input->getTime();
+}
+
+bool StarTrekEngine::hasFeature(EngineFeature f) const {
+	return (f == kSupportsLoadingDuringRuntime) || (f == kSupportsSavingDuringRuntime);
+}
+
+bool StarTrekEngine::canLoadGameStateCurrently() {
+	return !_sceneName.empty();
+}
+
+bool StarTrekEngine::canSaveGameStateCurrently() {
+	return !_sceneName.empty();
+}
+
+Common::String StarTrekEngine::getSaveStateName(const Common::String &target, int slot) {
+	return Common::String::printf("%s.%03d", target.c_str(), slot);
+}
+
+Common::Error StarTrekEngine::saveGameState(int slot, const char *desc) {
+	if (slot == AUTOSAVE_SLOT) {
+		warning("Slot %d is reserved for the autosave", slot);
+		return Common::kWritingFailed;
 	}
-		
-	dataFile->seek(indexOffset);
-	
-	if (getFeatures() & GF_DEMO) {
-		assert(fileCount == 1); // Sanity check...
-		Common::SeekableReadStream *stream = dataFile->readStream(uncompressedSize);
-		delete dataFile;
-		return stream;
-	} else {
-		uint16 fileIndex = 0;
-	
-		// TODO!
-		//if (fileCount > 1)
-		//	fileIndex = filename.lastChar() - '0';
-		if (fileCount != 1)
-			error ("Multi-part files not yet handled");
-	
-		for (uint16 i = 0; i < fileCount; i++) {
-			uncompressedSize = (getPlatform() == Common::kPlatformAmiga) ? dataFile->readUint16BE() : dataFile->readUint16LE();
-			uint16 compressedSize = (getPlatform() == Common::kPlatformAmiga) ? dataFile->readUint16BE() : dataFile->readUint16LE();
-			if (i == fileIndex) {
-				debug(0, "Opening file \'%s\'\n", filename.c_str());
-				Common::SeekableReadStream *stream = decodeLZSS(dataFile->readStream(compressedSize), uncompressedSize);
-				delete dataFile;
-				return stream;
-			} else {
-				dataFile->skip(compressedSize);
-			}
-		}
+
+	return writeSaveState(slot, desc);
+}
+
+Common::Error StarTrekEngine::writeSaveState(int slot, const char *desc) {
+	Common::OutSaveFile *out = _saveFileMan->openForSaving(getSaveStateName(_targetName, slot));
+	if (!out)
+		return Common::kCreatingFileFailed;
+
+	bool saved = _snapshot->save(out, desc);
+	out->finalize();
+	delete out;
+
+	return saved ? Common::kNoError : Common::kWritingFailed;
+}
+
+Common::Error StarTrekEngine::loadGameState(int slot) {
+	Common::InSaveFile *in = _saveFileMan->openForLoading(getSaveStateName(_targetName, slot));
+	if (!in)
+		return Common::kReadingFailed;
+
+	bool loaded = _snapshot->load(in);
+	delete in;
+
+	return loaded ? Common::kNoError : Common::kReadingFailed;
+}
+
+bool StarTrekEngine::hasFile(Common::String filename) {
+	return _archive->hasFile(filename);
+}
+
+Common::SeekableReadStream *StarTrekEngine::openFile(Common::String filename) {
+	Common::SeekableReadStream *stream = _prefetch->takeFile(filename);
+	uint32 waitTime = 0;
+
+	if (!stream) {
+		uint32 startTime = _system->getMillis();
+		stream = _archive->openFile(filename);
+		if (!stream)
+			error ("Could not find file \'%s\'", filename.c_str());
+
+		waitTime = _system->getMillis() - startTime;
+		_stats.resourceWaitTime += waitTime;
 	}
-	
-	// We should not get to this point...
-	error("Could not find data for \'%s\'", filename.c_str());
-		
-	return NULL;
+
+	_prefetch->recordOpen(filename, waitTime);
+	_stats.resourcesOpened++;
+	return stream;
 }
 
 byte StarTrekEngine::getStartingIndex(Common::String filename) {
@@ -269,15 +449,64 @@ byte StarTrekEngine::getStartingIndex(Common::String filename) {
 	return (filename[lastNumIndex] - '0');
 }
 
+Common::SeekableReadStream *StarTrekEngine::openMovieStream(Common::String filename) {
+	// Stream loose movie files straight from disk; anything else is
+	// decoded from the archive as it is read. Returns 0 if missing.
+	Common::SeekableReadStream *stream = SearchMan.createReadStreamForMember(filename);
+	if (stream)
+		return stream;
+
+	stream = _archive->openStreamingFile(filename);
+	if (stream)
+		_stats.resourcesOpened++;
+	return stream;
+}
+
 void StarTrekEngine::playMovie(Common::String filename) {
-	if (getPlatform() == Common::kPlatformMacintosh)
+	if (getPlatform() == Common::kPlatformMacintosh) {
 		playMovieMac(filename);
-	else
-		error("Interplay MVE not yet supported");
+		return;
+	}
+
+	MVEDecoder *mveDecoder = new MVEDecoder(_mixer);
+	mveDecoder->setMemoryTracker(_memoryTracker, filename);
+	mveDecoder->setClock(_input);
+	mveDecoder->setLatency(_sound->getLatency());
+
+	if (!mveDecoder->loadStream(openMovieStream(filename)))
+		error("Could not open '%s'", filename.c_str());
+
+	while (!mveDecoder->endOfVideo() && !shouldQuit()) {
+		if (mveDecoder->needsUpdate()) {
+			const ::Graphics::Surface *frame = mveDecoder->decodeNextFrame();
+
+			if (frame) {
+				if (mveDecoder->hasDirtyPalette())
+					_gfx->setScreenPalette(mveDecoder->getPalette(), 0, 256);
+
+				// Center the movie on the screen
+				uint16 width = MIN<uint16>(frame->w, 320);
+				uint16 height = MIN<uint16>(frame->h, 200);
+				_gfx->copyToScreen((byte *)frame->pixels, frame->pitch, (320 - width) / 2, (200 - height) / 2, width, height);
+				_gfx->updateScreen();
+			}
+		}
+
+		Common::Event event;
+		while (_input->pollEvent(event))
+			;
+		_input->endTick();
+
+		if (_input->getMode() != kInputReplay)
+			g_system->delayMillis(MIN<uint32>(mveDecoder->getTimeToNextFrame(), InputRecorder::TICK_MILLIS));
+	}
+
+	delete mveDecoder;
 }
 
 void StarTrekEngine::playMovieMac(Common::String filename) {
-	// Swap to 16bpp mode
+	// The QuickTime codecs decode into the screen's format, so the movies
+	// can only be shown in a high color mode
 	initGraphics(512, 384, true, NULL);
 
 	::Graphics::QuickTimeDecoder *qtDecoder = new ::Graphics::QuickTimeDecoder();
@@ -290,22 +519,27 @@ void StarTrekEngine::playMovieMac(Common::String filename) {
 			const ::Graphics::Surface *frame = qtDecoder->decodeNextFrame();
 
 			if (frame) {
-				_system->copyRectToScreen((byte *)frame->pixels, frame->pitch, 0, 0, frame->w, frame->h);
-				_system->updateScreen();
+				_gfx->copyToScreen((byte *)frame->pixels, frame->pitch, 0, 0, frame->w, frame->h);
+				_gfx->updateScreen();
 			}
 		}
 
+		// The decoder paces itself on the system clock, so this loop only
+		// keeps the input ticks going
 		Common::Event event;
-		while (g_system->getEventManager()->pollEvent(event))
+		while (_input->pollEvent(event))
 			;
+		_input->endTick();
 
-		g_system->delayMillis(10);
+		g_system->delayMillis(InputRecorder::TICK_MILLIS);
 	}
 
 	delete qtDecoder;
 
-	// Swap back to 8bpp mode
+	// Swap back to 8bpp mode, which replaced the game palette
 	initGraphics(320, 200, false);
+	_gfx->invalidateScreenPalette();
+	_gfx->refreshPalette();
 }
 
 } // End of namespace StarTrek
@@ -27,6 +27,7 @@
 #define STARTREK_H
 
 #include "common/scummsys.h"
+#include "common/array.h"
 #include "common/util.h"
 #include "common/system.h"
 #include "common/rect.h"
@@ -35,8 +36,10 @@
 
 #include "engines/engine.h"
 
+#include "startrek/console.h"
 #include "startrek/graphics.h"
 #include "startrek/sound.h"
+#include "startrek/stats.h"
 
 namespace Common {
 	class MacResManager;
@@ -54,7 +57,14 @@ enum StarTrekGameFeatures {
 };
 
 struct StarTrekGameDescription;
+class Arena;
 class Graphics;
+class InputRecorder;
+class MemoryTracker;
+class PrefetchManager;
+class ResourceArchive;
+class MemberCache;
+class SaveSnapshot;
 class Sound;
 
 class StarTrekEngine : public ::Engine {
@@ -73,18 +83,77 @@ public:
 	uint8 getGameType();
 	Common::Language getLanguage();
 
+	GUI::Debugger *getDebugger() { return _console; }
+
+	// Saved games
+	bool hasFeature(EngineFeature f) const;
+	bool canLoadGameStateCurrently();
+	bool canSaveGameStateCurrently();
+	Common::Error loadGameState(int slot);
+	Common::Error saveGameState(int slot, const char *desc);
+	static Common::String getSaveStateName(const Common::String &target, int slot);
+
+	// Written by the periodic autosave only, never from the save dialog
+	static const int AUTOSAVE_SLOT = 0;
+
+	// Startup timeline, in milliseconds since the engine was created
+	void traceStartup(const char *event);
+
 	// Resource related functions
 	Common::SeekableReadStream *openFile(Common::String filename);
+	bool hasFile(Common::String filename);
+	ResourceArchive *getArchive() { return _archive; }
+	EngineStats *getStats() { return &_stats; }
+
+	// Scenes bound the lifetime of the scene arena's allocations
+	void changeScene(const Common::String &name);
+	const Common::String &getSceneName() const { return _sceneName; }
+	uint32 getSceneCount() const { return _sceneCount; }
+	Arena *getSceneArena() { return _sceneArena; }
+	MemoryTracker *getMemoryTracker() { return _memoryTracker; }
+
+	// Game timing goes through this so replays repeat it exactly
+	uint32 getMillis() const;
+	PrefetchManager *getPrefetchManager() { return _prefetch; }
+	MemberCache *getMemberCache() { return _memberCache; } // 0 unless configured
 
 	// Movie related functions
+	Common::SeekableReadStream *openMovieStream(Common::String filename);
 	void playMovie(Common::String filename);
 	void playMovieMac(Common::String filename);
 	
 private:
+	friend class ArchiveBenchmark;
+	friend class Console;
+	friend class SaveSnapshot;
+
+	Console *_console;
 	Graphics *_gfx;
 	Sound *_sound;
 	Common::MacResManager *_macResFork;
+	ResourceArchive *_archive;
+	EngineStats _stats;
+	Arena *_sceneArena;
+	MemoryTracker *_memoryTracker;
+	PrefetchManager *_prefetch;
+	MemberCache *_memberCache;
+	InputRecorder *_input;
+	Common::String _sceneName;
+	uint32 _sceneCount;
+	SaveSnapshot *_snapshot;
+	uint32 _lastAutosaveTime;
+	Common::Error writeSaveState(int slot, const char *desc);
+
+	struct StartupEvent {
+		Common::String name;
+		uint32 time;
+	};
+	Common::Array<StartupEvent> _startupTrace;
+	uint32 _startTime;
 	
+	void initArchive();
+	void runBenchmark(const Common::String &filename);
+	void verifyArchive(const Common::String &filename);
 	byte getStartingIndex(Common::String filename);
 };
 
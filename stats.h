@@ -0,0 +1,97 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_STATS_H
+#define STARTREK_STATS_H
+
+#include "common/scummsys.h"
+
+namespace StarTrek {
+
+/**
+ * Counters shown by the debugger console. Some are updated from the mixer
+ * and timer threads without locking, they are only meant as statistics.
+ */
+struct EngineStats {
+	// Resources
+	uint32 resourcesOpened;
+	uint32 bytesRead; // From the archive's data file
+	uint32 bytesDecompressed;
+	uint32 resourceWaitTime; // in milliseconds, opening files that were not prefetched
+	uint32 filesPrefetched;
+	uint32 prefetchHits; // Stalls avoided
+	uint32 prefetchWasted;
+	uint32 prefetchTimeSaved; // in milliseconds, as recorded
+
+	// Graphics
+	uint32 framesPresented;
+	uint32 pixelsUploaded;
+	uint32 paletteUploads;
+
+	// Audio
+	uint32 sfxCacheHits;
+	uint32 sfxCacheMisses;
+	uint32 musicBankHits;
+	uint32 musicBankMisses;
+	uint32 midiCallbacks;
+	uint32 midiEventsSent;
+
+	EngineStats() {
+		resetResources();
+		resetGraphics();
+		resetAudio();
+	}
+
+	void resetResources() {
+		resourcesOpened = 0;
+		bytesRead = 0;
+		bytesDecompressed = 0;
+		resourceWaitTime = 0;
+		filesPrefetched = 0;
+		prefetchHits = 0;
+		prefetchWasted = 0;
+		prefetchTimeSaved = 0;
+	}
+
+	void resetGraphics() {
+		framesPresented = 0;
+		pixelsUploaded = 0;
+		paletteUploads = 0;
+	}
+
+	void resetAudio() {
+		sfxCacheHits = 0;
+		sfxCacheMisses = 0;
+		musicBankHits = 0;
+		musicBankMisses = 0;
+		midiCallbacks = 0;
+		midiEventsSent = 0;
+	}
+};
+
+} // End of namespace StarTrek
+
+#endif
@@ -0,0 +1,145 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#include "startrek/verify.h"
+
+#include "common/algorithm.h"
+#include "common/file.h"
+#include "common/system.h"
+#include "common/util.h"
+
+namespace StarTrek {
+
+uint32 ArchiveVerifier::computeCRC(const byte *data, uint32 size) {
+	static uint32 table[256];
+	static bool tableReady = false;
+
+	if (!tableReady) {
+		for (uint32 i = 0; i < 256; i++) {
+			uint32 crc = i;
+			for (byte j = 0; j < 8; j++)
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			table[i] = crc;
+		}
+		tableReady = true;
+	}
+
+	uint32 crc = 0xFFFFFFFF;
+	for (uint32 i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFF;
+}
+
+void ArchiveVerifier::run() {
+	Common::Array<Common::String> names;
+	_archive->listFiles(names);
+	Common::sort(names.begin(), names.end());
+
+	// Check what is in the data file, not what was cached from it, and do
+	// not fill the cache with every member
+	MemberCache *memberCache = _archive->getMemberCache();
+	_archive->setMemberCache(0);
+
+	_members.clear();
+	uint32 startTime = g_system->getMillis();
+
+	// The archive has one data stream and the engine no worker threads, so
+	// the members are checked one after the other
+	for (uint32 i = 0; i < names.size(); i++) {
+		VerifiedMember member;
+		member.name = names[i];
+		member.crc = 0;
+
+		Common::SeekableReadStream *stream = _archive->openMember(names[i], member.info);
+		if (!stream) {
+			member.info.storedSize = member.info.expectedSize = member.info.decodedSize = 0;
+			member.ok = false;
+			_members.push_back(member);
+			continue;
+		}
+
+		uint32 size = stream->size();
+		byte *data = (byte *)malloc(MAX<uint32>(size, 1));
+		uint32 bytesRead = stream->read(data, size);
+		delete stream;
+
+		member.crc = computeCRC(data, bytesRead);
+		member.ok = (bytesRead == size) && (member.info.decodedSize == member.info.expectedSize);
+
+		if (!_extractPath.empty() && !extractMember(names[i], data, bytesRead))
+			warning("Could not extract '%s'", names[i].c_str());
+
+		free(data);
+		_members.push_back(member);
+	}
+
+	_time = g_system->getMillis() - startTime;
+	_archive->setMemberCache(memberCache);
+}
+
+bool ArchiveVerifier::extractMember(const Common::String &name, const byte *data, uint32 size) {
+	Common::DumpFile file;
+	if (!file.open(_extractPath + '/' + name))
+		return false;
+
+	file.write(data, size);
+	file.flush();
+	return !file.err();
+}
+
+uint32 ArchiveVerifier::getCorruptCount() const {
+	uint32 count = 0;
+	for (uint32 i = 0; i < _members.size(); i++)
+		if (!_members[i].ok)
+			count++;
+	return count;
+}
+
+void ArchiveVerifier::getReport(Common::Array<Common::String> &lines) const {
+	uint32 storedBytes = 0, decodedBytes = 0;
+	for (uint32 i = 0; i < _members.size(); i++) {
+		storedBytes += _members[i].info.storedSize;
+		decodedBytes += _members[i].info.decodedSize;
+	}
+
+	// Decoding is not spread over threads, see run()
+	lines.push_back("decoding=sequential");
+	lines.push_back(Common::String::printf("members=%d", _members.size()));
+	lines.push_back(Common::String::printf("corrupt=%d", getCorruptCount()));
+	lines.push_back(Common::String::printf("stored_bytes=%d", storedBytes));
+	lines.push_back(Common::String::printf("decoded_bytes=%d", decodedBytes));
+	lines.push_back(Common::String::printf("time_ms=%d", _time));
+	lines.push_back(Common::String::printf("kb_per_sec=%d", _time ? decodedBytes / _time : 0));
+
+	for (uint32 i = 0; i < _members.size(); i++) {
+		const VerifiedMember &member = _members[i];
+		const char *status = member.ok ? "ok" : "corrupt";
+		lines.push_back(Common::String::printf("%s %08x %d %d %d %s", member.name.c_str(), member.crc, member.info.storedSize,
+				member.info.expectedSize, member.info.decodedSize, status));
+	}
+}
+
+} // End of namespace StarTrek
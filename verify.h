@@ -0,0 +1,79 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * $URL$
+ * $Id$
+ *
+ */
+
+
+#ifndef STARTREK_VERIFY_H
+#define STARTREK_VERIFY_H
+
+#include "common/array.h"
+#include "common/str.h"
+
+#include "startrek/archive.h"
+
+namespace StarTrek {
+
+struct VerifiedMember {
+	Common::String name;
+	MemberInfo info;
+	uint32 crc;
+	bool ok;
+};
+
+/**
+ * Decodes every member of an archive, one after the other, checks it
+ * decodes to the size its header gives and computes its CRC-32. The
+ * members can be written out to a directory as they are checked.
+ * Multi-part members are checked as their parts joined, as the engine
+ * reads them.
+ *
+ * Report lines are "<metric>=<value>" followed by one line per member:
+ * "<name> <crc> <stored size> <expected size> <decoded size> ok|corrupt".
+ */
+class ArchiveVerifier {
+public:
+	ArchiveVerifier(ResourceArchive *archive) : _archive(archive), _time(0) {}
+
+	void setExtractPath(const Common::String &path) { _extractPath = path; }
+
+	void run();
+	void getReport(Common::Array<Common::String> &lines) const;
+
+	const Common::Array<VerifiedMember> &getMembers() const { return _members; }
+	uint32 getCorruptCount() const;
+
+	static uint32 computeCRC(const byte *data, uint32 size);
+
+private:
+	ResourceArchive *_archive;
+	Common::String _extractPath;
+	Common::Array<VerifiedMember> _members;
+	uint32 _time; // in milliseconds
+
+	bool extractMember(const Common::String &name, const byte *data, uint32 size);
+};
+
+} // End of namespace StarTrek
+
+#endif